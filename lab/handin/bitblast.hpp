@@ -0,0 +1,211 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <unordered_map>
+#include "constraint_ir.hpp"
+#include "bitblaster.hpp"
+#include "sampler.hpp"
+
+// 结构哈希的AIG, 文字编号与AIGER一致: 0/1为常量, 第i个输入为2*(i+1)
+class AigLogic{
+public:
+    using Lit = uint32_t;
+    static const bool has_shapes = false;
+
+    explicit AigLogic(uint32_t num_inputs) : num_inputs(num_inputs) {}
+
+    Lit zero() const { return 0; }
+    Lit one() const { return 1; }
+    Lit input(uint32_t i) const { return 2 * (i + 1); }
+    Lit Not(Lit a) const { return a ^ 1; }
+
+    Lit And(Lit a, Lit b){
+        if(a > b)
+            std::swap(a, b);
+        if(a == 0 || a == (b ^ 1))
+            return 0;
+        if(a == 1 || a == b)
+            return b;
+        uint64_t key = (uint64_t)a << 32 | b;
+        auto it = table.find(key);
+        if(it != table.end())
+            return it->second;
+        Lit lhs = 2 * (num_inputs + 1 + (uint32_t)gates.size());
+        gates.emplace_back(lhs, a, b);
+        table.emplace(key, lhs);
+        return lhs;
+    }
+    Lit Or(Lit a, Lit b){
+        return Not(And(Not(a), Not(b)));
+    }
+    Lit Xor(Lit a, Lit b){
+        return Or(And(a, Not(b)), And(Not(a), b));
+    }
+    Lit Mux(Lit s, Lit t, Lit e){
+        if(t == e)
+            return t;
+        return Or(And(s, t), And(Not(s), e));
+    }
+    bool buildShape(const VarShape&, const Variable&, Lit&) const {
+        return false;
+    }
+
+    Aig finish(Lit output){
+        Aig aig;
+        aig.num_inputs = num_inputs;
+        aig.max_var = num_inputs + gates.size();
+        aig.output = output;
+        aig.gates = std::move(gates);
+        return aig;
+    }
+
+private:
+    uint32_t num_inputs;
+    std::vector<AND> gates;
+    std::unordered_map<uint64_t, Lit> table;
+};
+
+// 约束 -> AIG; bounds中的已知位成为常量, 不被任何门引用
+Aig bitblastAig(const ConstraintIR& ir, const ConstraintBounds* bounds = nullptr){
+    AigLogic logic(ir.num_bits);
+    BitBlaster<AigLogic> blaster(logic, ir, bounds);
+    return logic.finish(blaster.build());
+}
+
+// 带引用计数的BDD句柄
+class BddRef{
+public:
+    BddRef() = default;
+    BddRef(DdManager* mgr, DdNode* node) : mgr(mgr), node(node) {
+        if(node != nullptr)
+            Cudd_Ref(node);
+    }
+    BddRef(const BddRef& other) : BddRef(other.mgr, other.node) {}
+    BddRef(BddRef&& other) noexcept : mgr(other.mgr), node(other.node) {
+        other.node = nullptr;
+    }
+    BddRef& operator=(BddRef other) noexcept {
+        std::swap(mgr, other.mgr);
+        std::swap(node, other.node);
+        return *this;
+    }
+    ~BddRef(){
+        if(node != nullptr)
+            Cudd_RecursiveDeref(mgr, node);
+    }
+    DdNode* get() const {
+        return node;
+    }
+
+private:
+    DdManager* mgr = nullptr;
+    DdNode* node = nullptr;
+};
+
+// 直接在BDD上运算, 第i个输入为CUDD变量i+1 (与采样DAG中的位编号一致)
+class BddLogic{
+public:
+    using Lit = BddRef;
+    static const bool has_shapes = true;
+
+    explicit BddLogic(DdManager* mgr) : mgr(mgr) {}
+
+    Lit zero() const { return Lit(mgr, Cudd_ReadLogicZero(mgr)); }
+    Lit one() const { return Lit(mgr, Cudd_ReadOne(mgr)); }
+    Lit input(uint32_t i) const { return Lit(mgr, Cudd_bddIthVar(mgr, i + 1)); }
+    Lit Not(const Lit& a) const { return Lit(mgr, Cudd_Not(a.get())); }
+    Lit And(const Lit& a, const Lit& b) const { return Lit(mgr, Cudd_bddAnd(mgr, a.get(), b.get())); }
+    Lit Or(const Lit& a, const Lit& b) const { return Lit(mgr, Cudd_bddOr(mgr, a.get(), b.get())); }
+    Lit Xor(const Lit& a, const Lit& b) const { return Lit(mgr, Cudd_bddXor(mgr, a.get(), b.get())); }
+    Lit Mux(const Lit& s, const Lit& t, const Lit& e) const { return Lit(mgr, Cudd_bddIte(mgr, s.get(), t.get(), e.get())); }
+
+    // 按当前变量顺序自底向上直接构建变量与常量比较的BDD, 每一位只在已建好的部分之上加一层, O(位宽).
+    // 相等类 (含掩码) 对任意顺序都成立; 大小比较要求变量各位的层次按权重单调, 否则返回false走通用构建
+    bool buildShape(const VarShape& shape, const Variable& var, Lit& result) const {
+        size_t width = shape.k.size();
+        std::vector<Lit> xs;
+        std::vector<uint32_t> bits;
+        for(uint32_t i = 0; i < width; i++){
+            xs.push_back(input(var.first_bit + i));
+            if(shape.mask[i])
+                bits.push_back(i);
+        }
+        auto level = [&](uint32_t i){ return Cudd_ReadPerm(mgr, Cudd_NodeReadIndex(xs[i].get())); };
+
+        if(shape.op == Op::EQ || shape.op == Op::NEQ){
+            std::sort(bits.begin(), bits.end(), [&](uint32_t a, uint32_t b){ return level(a) > level(b); });
+            Lit cube = one();
+            for(uint32_t i : bits)
+                cube = shape.k[i] ? Mux(xs[i], cube, zero()) : Mux(xs[i], zero(), cube);
+            result = shape.op == Op::EQ ? cube : Not(cube);
+            return true;
+        }
+
+        bool msb_on_top = true, lsb_on_top = true;
+        for(uint32_t i = 1; i < width; i++){
+            msb_on_top &= level(i) < level(i - 1);
+            lsb_on_top &= level(i) > level(i - 1);
+        }
+        // x > k 即 !(x <= k), x >= k 即 !(x < k)
+        bool negate = shape.op == Op::GT || shape.op == Op::GTE;
+        bool or_equal = shape.op == Op::LTE || shape.op == Op::GT;
+        if(msb_on_top || width == 1){
+            // 最低位在最下层: 从低位往上, 当前位不同则由当前位决定, 相同则沿用低位的结果
+            Lit less = or_equal ? one() : zero();
+            for(uint32_t i = 0; i < width; i++){
+                const Lit& x = xs[i];
+                less = shape.k[i] ? Mux(x, less, one()) : Mux(x, zero(), less);
+            }
+            result = negate ? Not(less) : less;
+            return true;
+        }
+        if(lsb_on_top){
+            // 最高位在最下层: 自底向上记录 "低位部分是否已经小于k的低位" 两种情况下的结果
+            Lit if_less = one(), if_not_less = zero();
+            for(uint32_t i = width; i-- > 0;){
+                const Lit& x = xs[i];
+                // x_i = 1: k_i = 1时保持, 否则变为不小于; x_i = 0: k_i = 1时变为小于, 否则保持
+                Lit next_less = shape.k[i] ? Mux(x, if_less, if_less) : Mux(x, if_not_less, if_less);
+                Lit next_not_less = shape.k[i] ? Mux(x, if_not_less, if_less) : Mux(x, if_not_less, if_not_less);
+                if_less = next_less;
+                if_not_less = next_not_less;
+            }
+            Lit less = or_equal ? if_less : if_not_less;
+            result = negate ? Not(less) : less;
+            return true;
+        }
+        return false;
+    }
+
+private:
+    DdManager* mgr;
+};
+
+// 约束 -> BDD -> 采样DAG, 不经过AIG
+bool buildDagFromIR(const ConstraintIR& ir, const ConstraintBounds* bounds, SampleDag& dag){
+    DdManager* mgr = Cudd_Init(ir.num_bits + 1, 0, CUDD_UNIQUE_SLOTS * 2, CUDD_CACHE_SLOTS * 2, 0);
+    // 约束中没有出现的变量和已知位不会成为BDD结点, 固定它们的层次, 重排序时不必移动
+    std::vector<char> used(ir.num_bits + 1, false);
+    for(const ExprNode& node : ir.nodes){
+        if(node.op != Op::VAR)
+            continue;
+        const Variable& var = ir.vars[node.ref];
+        for(uint32_t i = 0; i < var.width; i++)
+            used[var.first_bit + i + 1] = bounds == nullptr || bounds->known[var.first_bit + i] < 0;
+    }
+    for(uint32_t v = 0; v <= ir.num_bits; v++)
+        if(!used[v])
+            Cudd_bddBindVar(mgr, v);
+    Cudd_AutodynEnable(mgr, CUDD_REORDER_GROUP_SIFT);
+    {
+        BddLogic logic(mgr);
+        BitBlaster<BddLogic> blaster(logic, ir, bounds);
+        BddRef root = blaster.build();
+        Cudd_AutodynDisable(mgr);
+        countSampleDag(mgr, root.get(), ir.num_bits + 1, dag);
+    }
+    Cudd_Quit(mgr);
+    return true;
+}
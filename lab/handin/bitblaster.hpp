@@ -0,0 +1,360 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <unordered_map>
+#include "constraint_ir.hpp"
+#include "constraint_bounds.hpp"
+
+// 把约束表达式按Verilog的位宽规则展开成逐位的布尔函数, 与json_to_verilog生成的模块经综合后的语义一致:
+//   - 算术/按位运算的操作数由上下文决定位宽 (取最大者), 在扩展后的位宽上运算
+//   - 比较的两个操作数互为上下文, 结果为1位; 逻辑运算、移位量、约束的归约或 (|(expr)) 的操作数自决定位宽
+//   - 变量按无符号处理 (生成的Verilog把所有输入声明为无符号), 表达式仅当所有操作数都有符号时有符号
+//   - 每个除法额外要求除数 (按自身位宽) 非零, 对应生成模块中的cnstrDIV; 非零常量除数不需要
+//   - 除以常量展开为乘法和移位
+// Logic提供底层的布尔运算, 可以是AIG, 也可以直接是BDD, 或者是常量 (化简时折叠常量子表达式).
+// 给出bounds时, 已知位直接取常量而不作为输入, 变量的区间最先合取
+template<class Logic>
+class BitBlaster{
+public:
+    using Lit = typename Logic::Lit;
+    using Bits = std::vector<Lit>;
+
+    BitBlaster(Logic& logic, const ConstraintIR& ir, const ConstraintBounds* bounds = nullptr)
+        : L(logic), ir(ir), bounds(bounds) {
+        inferSelfTypes(ir, self_width, self_signed);
+    }
+
+    // 所有约束与除数非零条件的合取
+    Lit build(){
+        Lit result = L.one();
+        if(bounds != nullptr){
+            for(uint32_t v = 0; v < ir.vars.size(); v++){
+                const VarBounds& b = bounds->vars[v];
+                if(!b.has_interval)
+                    continue;
+                Bits x = varBits(ir.vars[v]);
+                std::vector<char> lo(x.size()), hi(x.size());
+                for(size_t i = 0; i < x.size(); i++){
+                    lo[i] = b.lo >> i & 1;
+                    hi[i] = b.hi >> i & 1;
+                }
+                result = L.And(result, L.And(greaterConst(x, lo, false, true), lessConst(x, hi, false, true)));
+            }
+        }
+        for(uint32_t root : ir.constraints)
+            result = L.And(result, reduceOr(evalSelf(root)));
+        for(uint32_t i = 0; i < ir.nodes.size(); i++)
+            if(ir.nodes[i].op == Op::DIV && !isNonzeroConstant(ir, ir.nodes[i].rhs))
+                result = L.And(result, reduceOr(evalSelf(ir.nodes[i].rhs)));
+        return result;
+    }
+
+    // 在位宽width、符号is_signed的上下文中求值, 同一子表达式在同一上下文中只展开一次
+    Bits eval(uint32_t index, uint32_t width, bool is_signed){
+        uint64_t key = (uint64_t)index << 33 | (uint64_t)width << 1 | is_signed;
+        auto it = memo.find(key);
+        if(it != memo.end())
+            return it->second;
+        Bits bits = evalNode(index, width, is_signed);
+        memo.emplace(key, bits);
+        return bits;
+    }
+
+private:
+    Bits evalSelf(uint32_t node){
+        return eval(node, self_width[node], self_signed[node]);
+    }
+
+    Bits evalNode(uint32_t index, uint32_t width, bool is_signed){
+        const ExprNode& node = ir.nodes[index];
+        switch(node.op){
+            case Op::VAR:
+                return extend(varBits(ir.vars[node.ref]), width, false);
+            case Op::CONST: {
+                const Constant& c = ir.constants[node.ref];
+                Bits bits(c.width);
+                for(uint32_t i = 0; i < c.width; i++)
+                    bits[i] = c.bit(i) ? L.one() : L.zero();
+                return extend(bits, width, is_signed);
+            }
+            case Op::BIT_NEG: {
+                Bits a = eval(node.lhs, width, is_signed);
+                for(auto& bit : a)
+                    bit = L.Not(bit);
+                return a;
+            }
+            case Op::MINUS:
+                return negate(eval(node.lhs, width, is_signed));
+            case Op::ADD:
+                return add(eval(node.lhs, width, is_signed), eval(node.rhs, width, is_signed), L.zero());
+            case Op::SUB:
+                return sub(eval(node.lhs, width, is_signed), eval(node.rhs, width, is_signed));
+            case Op::MUL:
+                return mul(eval(node.lhs, width, is_signed), eval(node.rhs, width, is_signed));
+            case Op::DIV: {
+                DivMagic magic;
+                if(divisionMagic(ir, node.rhs, width, is_signed, magic))
+                    return divideConst(eval(node.lhs, width, is_signed), magic);
+                return divide(eval(node.lhs, width, is_signed), eval(node.rhs, width, is_signed), is_signed);
+            }
+            case Op::BIT_AND: case Op::BIT_OR: case Op::BIT_XOR: {
+                Bits a = eval(node.lhs, width, is_signed);
+                Bits b = eval(node.rhs, width, is_signed);
+                for(uint32_t i = 0; i < width; i++)
+                    a[i] = node.op == Op::BIT_AND ? L.And(a[i], b[i]) : node.op == Op::BIT_OR ? L.Or(a[i], b[i]) : L.Xor(a[i], b[i]);
+                return a;
+            }
+            case Op::LSHIFT: case Op::RSHIFT:
+                return shift(eval(node.lhs, width, is_signed), evalSelf(node.rhs), node.op == Op::LSHIFT);
+            case Op::LOG_NEG:
+                return extend({L.Not(reduceOr(evalSelf(node.lhs)))}, width, false);
+            case Op::LOG_AND:
+                return extend({L.And(reduceOr(evalSelf(node.lhs)), reduceOr(evalSelf(node.rhs)))}, width, false);
+            case Op::LOG_OR:
+                return extend({L.Or(reduceOr(evalSelf(node.lhs)), reduceOr(evalSelf(node.rhs)))}, width, false);
+            case Op::IMPLY:
+                return extend({L.Or(L.Not(reduceOr(evalSelf(node.lhs))), reduceOr(evalSelf(node.rhs)))}, width, false);
+            default:
+                return extend({compare(index)}, width, false);
+        }
+    }
+
+    Bits varBits(const Variable& var){
+        Bits bits(var.width);
+        for(uint32_t i = 0; i < var.width; i++){
+            int known = bounds != nullptr ? bounds->known[var.first_bit + i] : -1;
+            bits[i] = known < 0 ? L.input(var.first_bit + i) : known ? L.one() : L.zero();
+        }
+        return bits;
+    }
+
+    Lit compare(uint32_t index){
+        const ExprNode& node = ir.nodes[index];
+        // 变量与常量比较等形状由后端直接构建
+        VarShape shape;
+        if(Logic::has_shapes && matchVarShape(ir, index, shape)){
+            if(shape.constant >= 0)
+                return shape.constant ? L.one() : L.zero();
+            // 含已知位的变量走通用构建
+            Lit result;
+            bool has_known = bounds != nullptr && bounds->hasKnownBits(ir.vars[shape.var]);
+            if(!has_known && L.buildShape(shape, ir.vars[shape.var], result))
+                return result;
+        }
+        uint32_t width = std::max(self_width[node.lhs], self_width[node.rhs]);
+        bool is_signed = self_signed[node.lhs] && self_signed[node.rhs];
+        Bits a = eval(node.lhs, width, is_signed);
+        Bits b = eval(node.rhs, width, is_signed);
+        // 与常量比较: 逐位选择, 每位一次运算
+        if(ir.nodes[node.rhs].op == Op::CONST || ir.nodes[node.lhs].op == Op::CONST){
+            bool const_rhs = ir.nodes[node.rhs].op == Op::CONST;
+            const Bits& x = const_rhs ? a : b;
+            std::vector<char> k = constBits(const_rhs ? node.rhs : node.lhs, width, is_signed);
+            switch(node.op){
+                case Op::EQ: return equalConst(x, k);
+                case Op::NEQ: return L.Not(equalConst(x, k));
+                case Op::LT: return const_rhs ? lessConst(x, k, is_signed, false) : greaterConst(x, k, is_signed, false);
+                case Op::LTE: return const_rhs ? lessConst(x, k, is_signed, true) : greaterConst(x, k, is_signed, true);
+                case Op::GT: return const_rhs ? greaterConst(x, k, is_signed, false) : lessConst(x, k, is_signed, false);
+                default: return const_rhs ? greaterConst(x, k, is_signed, true) : lessConst(x, k, is_signed, true);
+            }
+        }
+        switch(node.op){
+            case Op::EQ: return equal(a, b);
+            case Op::NEQ: return L.Not(equal(a, b));
+            case Op::LT: return less(a, b, is_signed);
+            case Op::LTE: return L.Not(less(b, a, is_signed));
+            case Op::GT: return less(b, a, is_signed);
+            default: return L.Not(less(a, b, is_signed));
+        }
+    }
+
+    // 常量在给定上下文中的各位
+    std::vector<char> constBits(uint32_t index, uint32_t width, bool is_signed){
+        const Constant& c = ir.constants[ir.nodes[index].ref];
+        std::vector<char> k(width);
+        for(uint32_t i = 0; i < width; i++)
+            k[i] = i < c.width ? c.bit(i) : is_signed && c.bit(c.width - 1);
+        return k;
+    }
+
+    Lit equalConst(const Bits& x, const std::vector<char>& k){
+        Lit result = L.one();
+        for(size_t i = 0; i < x.size(); i++)
+            result = L.And(result, k[i] ? x[i] : L.Not(x[i]));
+        return result;
+    }
+
+    // x < k (or_equal时为x <= k), 从低位到高位: 当前位不同则由当前位决定, 相同则沿用低位的结果
+    Lit lessConst(const Bits& x, const std::vector<char>& k, bool is_signed, bool or_equal){
+        Lit result = or_equal ? L.one() : L.zero();
+        for(size_t i = 0; i < x.size(); i++){
+            bool flip = is_signed && i + 1 == x.size();
+            Lit xi = flip ? L.Not(x[i]) : x[i];
+            result = (k[i] != flip) ? L.Or(L.Not(xi), result) : L.And(L.Not(xi), result);
+        }
+        return result;
+    }
+
+    // x > k (or_equal时为x >= k)
+    Lit greaterConst(const Bits& x, const std::vector<char>& k, bool is_signed, bool or_equal){
+        return L.Not(lessConst(x, k, is_signed, !or_equal));
+    }
+
+    Bits extend(Bits bits, uint32_t width, bool is_signed){
+        Lit fill = is_signed && !bits.empty() ? bits.back() : L.zero();
+        bits.resize(width, fill);
+        return bits;
+    }
+
+    Lit reduceOr(const Bits& a){
+        Lit result = L.zero();
+        for(auto bit : a)
+            result = L.Or(result, bit);
+        return result;
+    }
+
+    Lit equal(const Bits& a, const Bits& b){
+        Lit result = L.one();
+        for(size_t i = 0; i < a.size(); i++)
+            result = L.And(result, L.Not(L.Xor(a[i], b[i])));
+        return result;
+    }
+
+    // a < b: a - b 产生借位. 有符号比较时翻转两者的符号位
+    Lit less(Bits a, Bits b, bool is_signed){
+        if(is_signed && !a.empty()){
+            a.back() = L.Not(a.back());
+            b.back() = L.Not(b.back());
+        }
+        Lit carry = L.one();
+        for(size_t i = 0; i < a.size(); i++)
+            carry = carryOut(a[i], L.Not(b[i]), carry);
+        return L.Not(carry);
+    }
+
+    Lit carryOut(Lit a, Lit b, Lit c){
+        return L.Or(L.And(a, b), L.And(c, L.Xor(a, b)));
+    }
+
+    Bits add(const Bits& a, const Bits& b, Lit carry){
+        Bits sum(a.size());
+        for(size_t i = 0; i < a.size(); i++){
+            Lit t = L.Xor(a[i], b[i]);
+            sum[i] = L.Xor(t, carry);
+            carry = L.Or(L.And(a[i], b[i]), L.And(carry, t));
+        }
+        return sum;
+    }
+
+    Bits sub(const Bits& a, Bits b){
+        for(auto& bit : b)
+            bit = L.Not(bit);
+        return add(a, b, L.one());
+    }
+
+    Bits negate(const Bits& a){
+        return sub(Bits(a.size(), L.zero()), a);
+    }
+
+    // 移位-累加, 结果截断到操作数位宽
+    Bits mul(const Bits& a, const Bits& b){
+        size_t width = a.size();
+        Bits product(width, L.zero());
+        for(size_t i = 0; i < width; i++){
+            Bits partial(width, L.zero());
+            for(size_t j = i; j < width; j++)
+                partial[j] = L.And(a[j - i], b[i]);
+            product = add(product, partial, L.zero());
+        }
+        return product;
+    }
+
+    // 恢复余数除法; 有符号时按绝对值相除再修正符号 (向零取整).
+    // 除数为零时的结果无关紧要, 该情形已被除数非零条件排除
+    Bits divide(const Bits& a, const Bits& b, bool is_signed){
+        size_t width = a.size();
+        if(is_signed && width > 0){
+            Lit a_neg = a.back(), b_neg = b.back();
+            Bits q = divide(select(a_neg, negate(a), a), select(b_neg, negate(b), b), false);
+            return select(L.Xor(a_neg, b_neg), negate(q), q);
+        }
+        Bits quotient(width), rem(width + 1, L.zero());
+        Bits divisor = extend(b, width + 1, false);
+        for(size_t i = width; i-- > 0;){
+            rem.insert(rem.begin(), a[i]);
+            rem.pop_back();
+            Bits diff = sub(rem, divisor);
+            Lit ge = L.Not(less(rem, divisor, false));
+            quotient[i] = ge;
+            rem = select(ge, diff, rem);
+        }
+        return quotient;
+    }
+
+    // 除以常量: 乘以magic.multiplier后取 [shift, shift + N) 位, 乘积位宽足以容纳 x * m
+    Bits divideConst(const Bits& a, const DivMagic& magic){
+        size_t width = a.size();
+        Bits quotient(width, L.zero());
+        if(magic.multiplier == 0){
+            for(size_t i = 0; i + magic.shift < width; i++)
+                quotient[i] = a[i + magic.shift];
+            return quotient;
+        }
+        size_t m_width = 0;
+        while(m_width < 128 && (magic.multiplier >> m_width) != 0)
+            m_width++;
+        Bits product(width + m_width, L.zero());
+        for(size_t j = 0; j < m_width; j++){
+            if(!(magic.multiplier >> j & 1))
+                continue;
+            Bits partial(product.size(), L.zero());
+            for(size_t i = 0; i < width; i++)
+                partial[i + j] = a[i];
+            product = add(product, partial, L.zero());
+        }
+        for(size_t i = 0; i < width && i + magic.shift < product.size(); i++)
+            quotient[i] = product[i + magic.shift];
+        return quotient;
+    }
+
+    Bits select(Lit s, const Bits& t, const Bits& e){
+        Bits result(t.size());
+        for(size_t i = 0; i < t.size(); i++)
+            result[i] = L.Mux(s, t[i], e[i]);
+        return result;
+    }
+
+    // 桶形移位器; 移位量按无符号处理, 不小于位宽时结果为0
+    Bits shift(Bits a, const Bits& amount, bool left){
+        size_t width = a.size();
+        Lit overflow = L.zero();
+        for(size_t j = 0; j < amount.size(); j++){
+            if(j >= 32 || (1ull << j) >= width){
+                overflow = L.Or(overflow, amount[j]);
+                continue;
+            }
+            size_t step = 1ull << j;
+            Bits shifted(width, L.zero());
+            for(size_t i = 0; i < width; i++){
+                if(left && i >= step)
+                    shifted[i] = a[i - step];
+                else if(!left && i + step < width)
+                    shifted[i] = a[i + step];
+            }
+            a = select(amount[j], shifted, a);
+        }
+        for(auto& bit : a)
+            bit = L.And(bit, L.Not(overflow));
+        return a;
+    }
+
+    Logic& L;
+    const ConstraintIR& ir;
+    const ConstraintBounds* bounds;
+    std::vector<uint32_t> self_width;
+    std::vector<char> self_signed;
+    std::unordered_map<uint64_t, Bits> memo;
+};
@@ -92,7 +92,7 @@ CPLUSPLUS_LIB="$CUDD_DIR/cplusplus/libs"
 CUDD_INCLUDE="$CUDD_DIR/cudd"
 
 EXEC_NAME="aig_to_BDD"
-CXX_FLAGS="-std=c++17"
+CXX_FLAGS="-std=c++17 -O2 -pthread"
 INCLUDE_FLAGS="-I$INCLUDE_DIR -I./cudd -I./cudd/epd -I./cudd/st -I./cudd/mtr -I./cudd/cplusplus -I$SRC_DIR -I$CUDD_INCLUDE"
 LINK_FLAGS="-L$CUDD_LIB -L$CPLUSPLUS_LIB -lcudd -lutil -lm -lstdc++"
 
@@ -109,10 +109,24 @@ if [ $? -ne 0 ]; then
     exit 1
 fi
 echo -e "\033[32mSuccess! run_dir/${EXEC_NAME}\033[0m"
+
+# 编译 constraint_sampler
+echo "==== Step 6: Compile constraint_sampler.cpp ===="
+SAMPLER_EXEC_NAME="constraint_sampler"
+
+echo "Compiling constraint_sampler.cpp..."
+g++ ${CXX_FLAGS} ${INCLUDE_FLAGS} "${SRC_DIR}/constraint_sampler.cpp" -o "run_dir/${SAMPLER_EXEC_NAME}" ${LINK_FLAGS}
+
+if [ $? -ne 0 ]; then
+    echo -e "\033[31mFailed: Unable to generate ${SAMPLER_EXEC_NAME}\033[0m"
+    exit 1
+fi
+echo -e "\033[32mSuccess! run_dir/${SAMPLER_EXEC_NAME}\033[0m"
 echo
 echo -e "\033[32m==== All has been compiled ====\033[0m"
 echo "- json_to_verilog.cpp: run_dir/json_to_verilog"
 echo "- json_to_bitwidth.cpp: run_dir/json_to_bitwidth"
 echo "- aig_to_BDD.cpp: run_dir/aig_to_BDD"
+echo "- constraint_sampler.cpp: run_dir/constraint_sampler"
 
 exit 0
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include "constraint_ir.hpp"
+
+// 约束直接给出的单个变量的取值范围: 区间与已知为常量的位.
+// 只看顶层的合取项 (化简后约束已按 && 拆开), 每一项都必须成立:
+//   var op const (比较)          -> 区间
+//   (var & mask) == const        -> mask中的位已知
+//   var / !(var)                 -> var >= 1 / 各位均为0
+// 区间只对不超过64位的变量记录. 区间的上下界共同的高位也是已知位, 反过来已知位也收紧区间.
+// 同一变量的条件互相矛盾时不记录该变量, 交给BDD得出无解
+struct VarBounds{
+    bool has_interval = false;      // 区间比已知位允许的范围更紧
+    uint64_t lo = 0;
+    uint64_t hi = 0;
+};
+
+struct ConstraintBounds{
+    std::vector<VarBounds> vars;
+    std::vector<signed char> known;     // 按AIG输入编号: -1为未知, 0/1为已知的值
+
+    bool hasKnownBits(const Variable& var) const {
+        for(uint32_t i = 0; i < var.width; i++)
+            if(known[var.first_bit + i] >= 0)
+                return true;
+        return false;
+    }
+
+    // 采样path的初值: 已知位不进入BDD, 由初值给出 (输入i对应path的第i+1位)
+    std::vector<uint64_t> pathTemplate() const {
+        return pathBits([](int value){ return value == 1; });
+    }
+
+    // 已知位在path中的掩码
+    std::vector<uint64_t> knownMask() const {
+        return pathBits([](int value){ return value >= 0; });
+    }
+
+private:
+    template<class Pred>
+    std::vector<uint64_t> pathBits(Pred pred) const {
+        std::vector<uint64_t> path((known.size() + 1 + 63) / 64, 0);
+        for(size_t i = 0; i < known.size(); i++)
+            if(pred(known[i]))
+                path[(i + 1) / 64] |= 1ull << ((i + 1) % 64);
+        return path;
+    }
+};
+
+ConstraintBounds analyzeBounds(const ConstraintIR& ir){
+    uint32_t num_vars = ir.vars.size();
+    std::vector<std::vector<signed char>> bits(num_vars);
+    std::vector<uint64_t> lo(num_vars, 0), hi(num_vars);
+    std::vector<char> conflict(num_vars, false);
+    for(uint32_t v = 0; v < num_vars; v++){
+        uint32_t width = ir.vars[v].width;
+        bits[v].assign(width, -1);
+        hi[v] = width >= 64 ? UINT64_MAX : (1ull << width) - 1;
+    }
+    auto setBit = [&](uint32_t v, uint32_t i, int value){
+        if(bits[v][i] >= 0 && bits[v][i] != value)
+            conflict[v] = true;
+        bits[v][i] = value;
+    };
+
+    for(uint32_t root : ir.constraints){
+        const ExprNode& node = ir.nodes[root];
+        if(node.op == Op::VAR){
+            lo[node.ref] = std::max<uint64_t>(lo[node.ref], 1);
+            continue;
+        }
+        if(node.op == Op::LOG_NEG && ir.nodes[node.lhs].op == Op::VAR){
+            uint32_t v = ir.nodes[node.lhs].ref;
+            for(uint32_t i = 0; i < ir.vars[v].width; i++)
+                setBit(v, i, 0);
+            continue;
+        }
+        VarShape shape;
+        if(!matchVarShape(ir, root, shape) || shape.constant >= 0)
+            continue;
+        uint32_t v = shape.var, width = ir.vars[v].width;
+        if(shape.op == Op::EQ){
+            for(uint32_t i = 0; i < width; i++)
+                if(shape.mask[i])
+                    setBit(v, i, shape.k[i]);
+            continue;
+        }
+        if(shape.op == Op::NEQ || width > 64)
+            continue;
+        uint64_t k = 0;
+        for(uint32_t i = 0; i < width; i++)
+            k |= (uint64_t)shape.k[i] << i;
+        switch(shape.op){
+            case Op::LT:
+                conflict[v] |= k == 0;
+                hi[v] = std::min(hi[v], k - 1);
+                break;
+            case Op::LTE:
+                hi[v] = std::min(hi[v], k);
+                break;
+            case Op::GT:
+                conflict[v] |= k == (width == 64 ? UINT64_MAX : (1ull << width) - 1);
+                lo[v] = std::max(lo[v], k + 1);
+                break;
+            default:
+                lo[v] = std::max(lo[v], k);
+        }
+    }
+
+    ConstraintBounds bounds;
+    bounds.vars.resize(num_vars);
+    bounds.known.assign(ir.num_bits, -1);
+    for(uint32_t v = 0; v < num_vars; v++){
+        const Variable& var = ir.vars[v];
+        if(var.width <= 64 && !conflict[v]){
+            // 已知位给出的范围与区间求交, 再把区间上下界共同的高位记为已知
+            uint64_t ones = 0, free = 0;
+            for(uint32_t i = 0; i < var.width; i++){
+                ones |= (uint64_t)(bits[v][i] == 1) << i;
+                free |= (uint64_t)(bits[v][i] < 0) << i;
+            }
+            uint64_t l = std::max(lo[v], ones), h = std::min(hi[v], ones | free);
+            if(l > h){
+                conflict[v] = true;
+            } else {
+                int differ = l == h ? -1 : 63 - __builtin_clzll(l ^ h);
+                for(uint32_t i = differ + 1; i < var.width; i++)
+                    setBit(v, i, l >> i & 1);
+                ones = free = 0;
+                for(uint32_t i = 0; i < var.width; i++){
+                    ones |= (uint64_t)(bits[v][i] == 1) << i;
+                    free |= (uint64_t)(bits[v][i] < 0) << i;
+                }
+                VarBounds& b = bounds.vars[v];
+                b.lo = l;
+                b.hi = h;
+                b.has_interval = l > ones || h < (ones | free);
+            }
+        }
+        if(conflict[v]){
+            bounds.vars[v] = VarBounds();
+            continue;
+        }
+        for(uint32_t i = 0; i < var.width; i++)
+            bounds.known[var.first_bit + i] = bits[v][i];
+    }
+    return bounds;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <numeric>
+#include "constraint_ir.hpp"
+#include "constraint_simplify.hpp"
+
+// 按变量把约束分成互相独立的几部分: 约束与其中出现的变量相连, 连通的约束归为一部分.
+// 各部分的解互不影响, 整个约束的解就是各部分的解拼起来, 可以各自构建BDD并独立采样.
+// 每一部分保留完整的变量表 (变量的位编号不变, 各部分的样本直接写到同一个path中),
+// 只含本部分的约束和它们用到的结点. 不含变量的约束单独成为一部分; 没有约束时返回原约束
+std::vector<ConstraintIR> splitComponents(const ConstraintIR& ir){
+    std::vector<uint32_t> parent(ir.vars.size());
+    std::iota(parent.begin(), parent.end(), 0);
+    auto find = [&](uint32_t v){
+        while(parent[v] != v)
+            v = parent[v] = parent[parent[v]];
+        return v;
+    };
+
+    // 每个约束中出现的第一个变量, 没有变量时为NO_NODE. 共享的子表达式在同一个约束中只访问一次
+    std::vector<uint32_t> first_var(ir.constraints.size(), NO_NODE);
+    std::vector<uint32_t> visited_by(ir.nodes.size(), NO_NODE);
+    for(uint32_t c = 0; c < ir.constraints.size(); c++){
+        std::vector<uint32_t> stack{ir.constraints[c]};
+        while(!stack.empty()){
+            uint32_t i = stack.back();
+            stack.pop_back();
+            if(visited_by[i] == c)
+                continue;
+            visited_by[i] = c;
+            const ExprNode& node = ir.nodes[i];
+            if(node.op == Op::VAR){
+                if(first_var[c] == NO_NODE)
+                    first_var[c] = node.ref;
+                else
+                    parent[find(node.ref)] = find(first_var[c]);
+            }
+            for(uint32_t child : {node.lhs, node.rhs})
+                if(child != NO_NODE)
+                    stack.push_back(child);
+        }
+    }
+
+    std::vector<std::vector<uint32_t>> roots;
+    std::vector<int> part_of(ir.vars.size(), -1);
+    for(uint32_t c = 0; c < ir.constraints.size(); c++){
+        int part = first_var[c] == NO_NODE ? -1 : part_of[find(first_var[c])];
+        if(part < 0){
+            part = roots.size();
+            if(first_var[c] != NO_NODE)
+                part_of[find(first_var[c])] = part;
+            roots.emplace_back();
+        }
+        roots[part].push_back(ir.constraints[c]);
+    }
+    std::vector<ConstraintIR> parts;
+    for(const auto& part_roots : roots)
+        parts.push_back(extractConstraints(ir, part_roots));
+    if(parts.empty())
+        parts.push_back(ir);
+    return parts;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstdio>
+#include "constraint_ir.hpp"
+
+// 64位FNV-1a
+uint64_t fnv1a(const void* data, size_t size, uint64_t h = 1469598103934665603ull) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; i++)
+        h = (h ^ bytes[i]) * 1099511628211ull;
+    return h;
+}
+
+template<class T>
+void appendValue(std::string& text, const T& value) {
+    text.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void appendString(std::string& text, const std::string& value) {
+    appendValue(text, (uint64_t)value.size());
+    text += value;
+}
+
+// 约束的完整键: 解析后的IR (变量、表达式结构和常量的值) 和工具选项的二进制序列化, 与JSON的键顺序、空白、
+// 常量的写法 (如8'h0f与8'd15) 无关. 写进缓存文件, 加载时逐字节比较
+std::string constraint_key_text(const ConstraintIR& ir, const std::vector<std::string>& options) {
+    std::string text;
+    appendValue(text, (uint64_t)ir.vars.size());
+    for (const auto& var : ir.vars) {
+        appendString(text, var.name);
+        appendValue(text, var.width);
+    }
+    appendValue(text, (uint64_t)ir.nodes.size());
+    for (const auto& node : ir.nodes) {
+        appendValue(text, (uint8_t)node.op);
+        if (node.op == Op::CONST) {
+            const Constant& c = ir.constants[node.ref];
+            appendValue(text, c.width);
+            appendValue(text, c.is_signed);
+            appendValue(text, (uint64_t)c.words.size());
+            text.append(reinterpret_cast<const char*>(c.words.data()), c.words.size() * sizeof(uint64_t));
+        } else {
+            appendValue(text, node.lhs);
+            appendValue(text, node.rhs);
+            appendValue(text, node.ref);
+        }
+    }
+    appendValue(text, (uint64_t)ir.constraints.size());
+    text.append(reinterpret_cast<const char*>(ir.constraints.data()), ir.constraints.size() * sizeof(uint32_t));
+    appendValue(text, (uint64_t)options.size());
+    for (const auto& option : options)
+        appendString(text, option);
+    return text;
+}
+
+// 完整键的64位哈希, 作为编译结果缓存的文件名
+std::string constraint_key(const std::string& key_text) {
+    uint64_t h = fnv1a(key_text.data(), key_text.size());
+    char key[17];
+    snprintf(key, sizeof(key), "%016llx", (unsigned long long)h);
+    return key;
+}
@@ -0,0 +1,582 @@
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
+#include <algorithm>
+#include "nlohmann/json.hpp"
+
+using json = nlohmann::json;
+
+// 约束表达式的紧凑表示: 所有节点放在一个数组里, 子节点的下标总是小于父节点
+enum class Op : uint8_t {
+    LOG_NEG, BIT_NEG, MINUS,
+    ADD, SUB, MUL, DIV,
+    LOG_AND, LOG_OR, IMPLY,
+    EQ, NEQ, LT, LTE, GT, GTE,
+    BIT_AND, BIT_OR, BIT_XOR,
+    RSHIFT, LSHIFT,
+    VAR, CONST
+};
+
+const uint32_t NO_NODE = UINT32_MAX;
+
+struct ExprNode{
+    Op op;
+    uint32_t lhs = NO_NODE;
+    uint32_t rhs = NO_NODE;
+    uint32_t ref = 0;           // VAR: 变量编号, CONST: 常量编号
+};
+
+// Verilog常量: 带位宽的值, 按64位小端分组
+struct Constant{
+    uint32_t width = 32;
+    bool is_signed = false;
+    std::vector<uint64_t> words;
+
+    bool bit(uint32_t i) const {
+        return i / 64 < words.size() && (words[i / 64] >> (i % 64) & 1);
+    }
+};
+
+struct Variable{
+    std::string name;
+    uint32_t width;
+    uint32_t first_bit;         // 在所有变量拼接成的输入中的起始位
+    bool is_signed;
+};
+
+struct ConstraintIR{
+    std::vector<Variable> vars;
+    std::vector<ExprNode> nodes;
+    std::vector<Constant> constants;
+    std::vector<std::string> constant_text;    // 常量的原始写法, 用于生成Verilog
+    std::vector<uint32_t> constraints;
+    uint32_t num_bits = 0;
+};
+
+bool operator==(const ExprNode& a, const ExprNode& b){
+    return a.op == b.op && a.lhs == b.lhs && a.rhs == b.rhs && a.ref == b.ref;
+}
+
+struct ExprNodeHash{
+    size_t operator()(const ExprNode& node) const {
+        uint64_t h = (uint64_t)node.op;
+        h = h * 0x9e3779b97f4a7c15ull ^ node.lhs;
+        h = h * 0x9e3779b97f4a7c15ull ^ node.rhs;
+        h = h * 0x9e3779b97f4a7c15ull ^ node.ref;
+        return h ^ (h >> 31);
+    }
+};
+
+bool isUnary(Op op){
+    return op == Op::LOG_NEG || op == Op::BIT_NEG || op == Op::MINUS;
+}
+
+bool parseOp(const std::string& name, Op& op){
+    static const std::unordered_map<std::string, Op> ops = {
+        {"LOG_NEG", Op::LOG_NEG}, {"BIT_NEG", Op::BIT_NEG}, {"MINUS", Op::MINUS},
+        {"ADD", Op::ADD}, {"SUB", Op::SUB}, {"MUL", Op::MUL}, {"DIV", Op::DIV},
+        {"LOG_AND", Op::LOG_AND}, {"LOG_OR", Op::LOG_OR}, {"IMPLY", Op::IMPLY},
+        {"EQ", Op::EQ}, {"NEQ", Op::NEQ}, {"LT", Op::LT}, {"LTE", Op::LTE}, {"GT", Op::GT}, {"GTE", Op::GTE},
+        {"BIT_AND", Op::BIT_AND}, {"BIT_OR", Op::BIT_OR}, {"BIT_XOR", Op::BIT_XOR},
+        {"RSHIFT", Op::RSHIFT}, {"LSHIFT", Op::LSHIFT},
+        {"VAR", Op::VAR}, {"CONST", Op::CONST}
+    };
+    auto it = ops.find(name);
+    if(it == ops.end())
+        return false;
+    op = it->second;
+    return true;
+}
+
+// 解析Verilog数字, 如 14'h9, 8'sb1010_0101, 'd12, 42 (不带位宽的十进制数是32位有符号数).
+// x/z位按0处理
+bool parseConstant(const std::string& text, Constant& c){
+    size_t quote = text.find('\'');
+    std::string digits;
+    uint32_t radix_bits = 0;    // 0表示十进制
+    c = Constant();
+    if(quote == std::string::npos){
+        c.is_signed = true;
+        digits = text;
+    } else {
+        if(quote > 0){
+            try {
+                c.width = std::stoul(text.substr(0, quote));
+            } catch (const std::exception&) {
+                return false;
+            }
+            if(c.width == 0)
+                return false;
+        }
+        size_t pos = quote + 1;
+        if(pos < text.size() && (text[pos] == 's' || text[pos] == 'S')){
+            c.is_signed = true;
+            pos++;
+        }
+        if(pos >= text.size())
+            return false;
+        switch(text[pos]){
+            case 'b': case 'B': radix_bits = 1; break;
+            case 'o': case 'O': radix_bits = 3; break;
+            case 'h': case 'H': radix_bits = 4; break;
+            case 'd': case 'D': radix_bits = 0; break;
+            default: return false;
+        }
+        digits = text.substr(pos + 1);
+    }
+
+    c.words.assign((c.width + 63) / 64, 0);
+    bool any = false;
+    for(char ch : digits){
+        if(ch == '_')
+            continue;
+        uint32_t digit;
+        if(ch >= '0' && ch <= '9')
+            digit = ch - '0';
+        else if(ch >= 'a' && ch <= 'f')
+            digit = ch - 'a' + 10;
+        else if(ch >= 'A' && ch <= 'F')
+            digit = ch - 'A' + 10;
+        else if(ch == 'x' || ch == 'X' || ch == 'z' || ch == 'Z' || ch == '?')
+            digit = 0;
+        else
+            return false;
+        if(digit >= (radix_bits == 0 ? 10u : 1u << radix_bits))
+            return false;
+        any = true;
+        // value = value * radix + digit, 超出位宽的部分截断
+        uint64_t carry = digit;
+        for(auto& word : c.words){
+            unsigned __int128 v = radix_bits == 0 ? (unsigned __int128)word * 10 + carry
+                                                  : ((unsigned __int128)word << radix_bits) | carry;
+            word = (uint64_t)v;
+            carry = (uint64_t)(v >> 64);
+        }
+    }
+    if(c.width % 64 != 0)
+        c.words.back() &= (1ull << (c.width % 64)) - 1;
+    return any;
+}
+
+// 向IR中添加常量和节点: 值相同的常量 (如8'h0f与8'd15) 和结构相同的节点只保存一份, 表达式成为DAG
+class IRBuilder{
+public:
+    explicit IRBuilder(ConstraintIR& ir) : ir(ir) {}
+
+    uint32_t constant(const Constant& c, const std::string& text){
+        std::string key((const char*)c.words.data(), c.words.size() * sizeof(uint64_t));
+        key += std::to_string(c.width) + (c.is_signed ? "s" : "u");
+        auto it = constants.emplace(key, (uint32_t)ir.constants.size());
+        if(it.second){
+            ir.constants.push_back(c);
+            ir.constant_text.push_back(text);
+        }
+        return it.first->second;
+    }
+
+    uint32_t node(const ExprNode& node){
+        auto it = nodes.emplace(node, (uint32_t)ir.nodes.size());
+        if(it.second)
+            ir.nodes.push_back(node);
+        return it.first->second;
+    }
+
+private:
+    ConstraintIR& ir;
+    std::unordered_map<std::string, uint32_t> constants;
+    std::unordered_map<ExprNode, uint32_t, ExprNodeHash> nodes;
+};
+
+// 用SAX事件从字节流直接构建IR, 不建立JSON DOM: 只保留正在解析的对象路径上的少量状态,
+// 表达式对象结束时即经IRBuilder写入节点数组 (子节点先于父节点).
+// 不认识的键连同其值整体跳过
+class ConstraintSax{
+public:
+    explicit ConstraintSax(ConstraintIR& ir) : ir(ir) {}
+
+    bool null(){
+        return scalar();
+    }
+    bool boolean(bool value){
+        if(!stack.empty() && stack.back().kind == VAR && stack.back().key == "signed"){
+            stack.back().is_signed = value;
+            return true;
+        }
+        return scalar();
+    }
+    bool number_integer(json::number_integer_t value){
+        return number(value);
+    }
+    bool number_unsigned(json::number_unsigned_t value){
+        return number(value > (json::number_unsigned_t)INT64_MAX ? -1 : (int64_t)value);
+    }
+    bool number_float(json::number_float_t, const std::string&){
+        return scalar();
+    }
+    bool binary(json::binary_t&){
+        return scalar();
+    }
+    bool string(std::string& value){
+        if(stack.empty())
+            return fail("Unexpected string");
+        Frame& top = stack.back();
+        if(top.kind == VAR && top.key == "name"){
+            top.name = std::move(value);
+            return true;
+        }
+        if(top.kind == EXPR && top.key == "op"){
+            if(!parseOp(value, top.op))
+                return fail("Unknown op " + value);
+            top.has_op = true;
+            return true;
+        }
+        if(top.kind == EXPR && top.key == "value"){
+            auto it = interned.find(value);
+            if(it == interned.end()){
+                Constant c;
+                if(!parseConstant(value, c))
+                    return fail("Cannot parse constant " + value);
+                it = interned.emplace(value, builder.constant(c, value)).first;
+            }
+            top.constant = it->second;
+            return true;
+        }
+        return scalar();
+    }
+
+    bool start_object(std::size_t){
+        Kind parent = stack.empty() ? NONE : stack.back().kind;
+        if(parent == NONE)
+            stack.emplace_back(ROOT);
+        else if(parent == VAR_LIST)
+            stack.emplace_back(VAR);
+        else if(parent == CONSTRAINT_LIST)
+            stack.emplace_back(EXPR);
+        else if(parent == EXPR && (stack.back().key == "lhs_expression" || stack.back().key == "rhs_expression"))
+            stack.emplace_back(EXPR);
+        else
+            stack.emplace_back(SKIP);
+        return true;
+    }
+    bool key(std::string& name){
+        stack.back().key = std::move(name);
+        return true;
+    }
+    bool end_object(){
+        Frame frame = std::move(stack.back());
+        stack.pop_back();
+        if(frame.kind == VAR){
+            if(frame.name.empty() || frame.width <= 0)
+                return fail("Bad variable " + std::to_string(ir.vars.size()));
+            ir.vars.push_back({frame.name, (uint32_t)frame.width, 0, frame.is_signed});
+        } else if(frame.kind == EXPR){
+            return endExpr(frame);
+        }
+        return true;
+    }
+    bool start_array(std::size_t){
+        if(stack.empty())
+            return fail("Expected an object");
+        Frame& top = stack.back();
+        if(top.kind == ROOT && top.key == "variable_list")
+            stack.emplace_back(VAR_LIST);
+        else if(top.kind == ROOT && top.key == "constraint_list")
+            stack.emplace_back(CONSTRAINT_LIST);
+        else
+            stack.emplace_back(SKIP);
+        return true;
+    }
+    bool end_array(){
+        stack.pop_back();
+        return true;
+    }
+    bool parse_error(std::size_t, const std::string&, const nlohmann::detail::exception& e){
+        return fail(e.what());
+    }
+
+    // 解析结束后检查变量引用并确定各变量的位置
+    bool finish(){
+        if(!error.empty())
+            return false;
+        for(auto& var : ir.vars){
+            var.first_bit = ir.num_bits;
+            ir.num_bits += var.width;
+        }
+        for(const auto& node : ir.nodes)
+            if(node.op == Op::VAR && node.ref >= ir.vars.size())
+                return fail("Unknown variable " + std::to_string(node.ref));
+        return true;
+    }
+
+    std::string error;
+
+private:
+    enum Kind { NONE, ROOT, VAR_LIST, VAR, CONSTRAINT_LIST, EXPR, SKIP };
+
+    struct Frame{
+        Kind kind;
+        std::string key;
+        std::string name;
+        int64_t width = -1;     // VAR: bit_width, EXPR: 变量编号
+        bool is_signed = false;
+        bool has_op = false;
+        Op op = Op::CONST;
+        uint32_t lhs = NO_NODE;
+        uint32_t rhs = NO_NODE;
+        uint32_t constant = NO_NODE;
+
+        explicit Frame(Kind kind) : kind(kind) {}
+    };
+
+    bool fail(const std::string& message){
+        if(error.empty())
+            error = message;
+        return false;
+    }
+
+    bool scalar(){
+        if(stack.empty())
+            return fail("Expected an object");
+        Kind kind = stack.back().kind;
+        if(kind == VAR_LIST || kind == CONSTRAINT_LIST)
+            return fail(kind == VAR_LIST ? "Bad variable_list" : "Bad constraint_list");
+        return true;
+    }
+
+    bool number(int64_t value){
+        if(!stack.empty()){
+            Frame& top = stack.back();
+            if((top.kind == VAR && top.key == "bit_width") || (top.kind == EXPR && top.key == "id")){
+                top.width = value;
+                return true;
+            }
+        }
+        return scalar();
+    }
+
+    bool endExpr(const Frame& frame){
+        ExprNode node;
+        node.op = frame.op;
+        if(!frame.has_op)
+            return fail("Expression without op");
+        if(node.op == Op::VAR){
+            if(frame.width < 0 || frame.width > UINT32_MAX)
+                return fail("Bad variable id");
+            node.ref = frame.width;
+        } else if(node.op == Op::CONST){
+            if(frame.constant == NO_NODE)
+                return fail("Constant without value");
+            node.ref = frame.constant;
+        } else {
+            if(frame.lhs == NO_NODE || (!isUnary(node.op) && frame.rhs == NO_NODE))
+                return fail("Missing operand");
+            node.lhs = frame.lhs;
+            node.rhs = isUnary(node.op) ? NO_NODE : frame.rhs;
+        }
+        uint32_t index = builder.node(node);
+        Frame& parent = stack.back();
+        if(parent.kind == CONSTRAINT_LIST)
+            ir.constraints.push_back(index);
+        else if(parent.key == "lhs_expression")
+            parent.lhs = index;
+        else
+            parent.rhs = index;
+        return true;
+    }
+
+    ConstraintIR& ir;
+    std::vector<Frame> stack;
+    IRBuilder builder{ir};
+    std::unordered_map<std::string, uint32_t> interned;     // 常量文本 -> 常量编号
+};
+
+bool parseConstraints(std::istream& in, ConstraintIR& ir, std::string& error){
+    ir = ConstraintIR();
+    ConstraintSax sax(ir);
+    bool ok = json::sax_parse(in, &sax) && sax.finish();
+    error = sax.error;
+    return ok;
+}
+
+bool parseConstraintFile(const std::string& filename, ConstraintIR& ir){
+    std::ifstream in(filename, std::ios::binary);
+    if(!in){
+        std::cerr<<"Cannot open "<<filename<<"\n";
+        return false;
+    }
+    std::string error;
+    if(!parseConstraints(in, ir, error)){
+        std::cerr<<"Cannot parse "<<filename<<": "<<error<<"\n";
+        return false;
+    }
+    return true;
+}
+
+// 按Verilog规则求节点i的自决定位宽和符号, 子节点的结果须已求出.
+// 变量按无符号处理, 比较和逻辑运算的结果为1位无符号数
+void inferSelfType(const ConstraintIR& ir, uint32_t i, std::vector<uint32_t>& self_width, std::vector<char>& self_signed){
+    if(self_width.size() <= i){
+        self_width.resize(i + 1);
+        self_signed.resize(i + 1);
+    }
+    const ExprNode& node = ir.nodes[i];
+    self_width[i] = 1;
+    self_signed[i] = false;
+    switch(node.op){
+        case Op::VAR:
+            self_width[i] = ir.vars[node.ref].width;
+            break;
+        case Op::CONST:
+            self_width[i] = ir.constants[node.ref].width;
+            self_signed[i] = ir.constants[node.ref].is_signed;
+            break;
+        case Op::BIT_NEG: case Op::MINUS: case Op::LSHIFT: case Op::RSHIFT:
+            self_width[i] = self_width[node.lhs];
+            self_signed[i] = self_signed[node.lhs];
+            break;
+        case Op::ADD: case Op::SUB: case Op::MUL: case Op::DIV:
+        case Op::BIT_AND: case Op::BIT_OR: case Op::BIT_XOR:
+            self_width[i] = std::max(self_width[node.lhs], self_width[node.rhs]);
+            self_signed[i] = self_signed[node.lhs] && self_signed[node.rhs];
+            break;
+        default:
+            break;
+    }
+}
+
+// 子节点的下标总小于父节点, 顺序扫描即可
+void inferSelfTypes(const ConstraintIR& ir, std::vector<uint32_t>& self_width, std::vector<char>& self_signed){
+    self_width.assign(ir.nodes.size(), 1);
+    self_signed.assign(ir.nodes.size(), false);
+    for(uint32_t i = 0; i < ir.nodes.size(); i++)
+        inferSelfType(ir, i, self_width, self_signed);
+}
+
+// 比较和逻辑运算: 结果为1位, 与所在的上下文无关
+bool isBoolean(Op op){
+    return op == Op::LOG_NEG || (op >= Op::LOG_AND && op <= Op::GTE);
+}
+
+// 可以直接构建的约束形状: var op const (op为比较), 以及 (var & mask) ==/!= value.
+// k, mask按变量位宽截断; 结果与变量无关时constant为0或1
+struct VarShape{
+    Op op;
+    uint32_t var;
+    std::vector<char> k;
+    std::vector<char> mask;
+    int constant = -1;
+};
+
+Op swapCompare(Op op){
+    switch(op){
+        case Op::LT: return Op::GT;
+        case Op::LTE: return Op::GTE;
+        case Op::GT: return Op::LT;
+        case Op::GTE: return Op::LTE;
+        default: return op;
+    }
+}
+
+bool matchVarShape(const ConstraintIR& ir, uint32_t index, VarShape& shape){
+    const ExprNode& node = ir.nodes[index];
+    if(node.op < Op::EQ || node.op > Op::GTE)
+        return false;
+    uint32_t lhs = node.lhs, rhs = node.rhs;
+    shape.op = node.op;
+    if(ir.nodes[lhs].op == Op::CONST){
+        std::swap(lhs, rhs);
+        shape.op = swapCompare(shape.op);
+    }
+    if(ir.nodes[rhs].op != Op::CONST)
+        return false;
+
+    // 变量按无符号处理, 比较在两侧位宽的最大值上以无符号进行
+    const Constant& c = ir.constants[ir.nodes[rhs].ref];
+    uint32_t x, width;
+    const ExprNode& left = ir.nodes[lhs];
+    std::vector<char> mask;
+    if(left.op == Op::VAR){
+        x = left.ref;
+        width = ir.vars[x].width;
+        mask.assign(width, 1);
+    } else if(left.op == Op::BIT_AND && (shape.op == Op::EQ || shape.op == Op::NEQ)){
+        uint32_t v = left.lhs, m = left.rhs;
+        if(ir.nodes[v].op == Op::CONST)
+            std::swap(v, m);
+        if(ir.nodes[v].op != Op::VAR || ir.nodes[m].op != Op::CONST)
+            return false;
+        x = ir.nodes[v].ref;
+        width = ir.vars[x].width;
+        const Constant& mc = ir.constants[ir.nodes[m].ref];
+        mask.resize(width);
+        for(uint32_t i = 0; i < width; i++)
+            mask[i] = i < mc.width && mc.bit(i);
+    } else {
+        return false;
+    }
+    shape.var = x;
+    shape.mask = mask;
+    shape.k.resize(width);
+    bool high = false, outside = false;
+    for(uint32_t i = 0; i < c.width; i++){
+        if(i < width){
+            shape.k[i] = c.bit(i);
+            outside |= shape.k[i] && !mask[i];
+        } else {
+            high |= c.bit(i);
+        }
+    }
+    // 常量超出变量的取值范围
+    if(high || outside){
+        bool below = shape.op == Op::LT || shape.op == Op::LTE || shape.op == Op::NEQ;
+        shape.constant = below;
+    }
+    return true;
+}
+
+// 按自身位宽非零的常量; 以它为除数时不需要非零条件
+bool isNonzeroConstant(const ConstraintIR& ir, uint32_t index){
+    if(ir.nodes[index].op != Op::CONST)
+        return false;
+    for(uint64_t word : ir.constants[ir.nodes[index].ref].words)
+        if(word != 0)
+            return true;
+    return false;
+}
+
+// 除以常量改写为乘法和移位. N位无符号的x除以d, 2^(l-1) < d < 2^l 时取 m = ceil(2^(N+l) / d),
+// m至多N+1位, 且 x / d = (x * m) >> (N+l); d为2的幂时 x / d = x >> l, 此时multiplier为0.
+// 只处理不超过64位的无符号上下文 (有符号的除法在化简时已被折叠) 中的非零常量除数
+struct DivMagic{
+    unsigned __int128 multiplier = 0;
+    uint32_t shift = 0;
+};
+
+bool divisionMagic(const ConstraintIR& ir, uint32_t divisor, uint32_t width, bool is_signed, DivMagic& magic){
+    if(is_signed || width > 64 || ir.nodes[divisor].op != Op::CONST)
+        return false;
+    // 无符号上下文中常量按0扩展, 再截断到上下文位宽
+    const Constant& c = ir.constants[ir.nodes[divisor].ref];
+    uint64_t d = c.words.empty() ? 0 : c.words[0];
+    if(width < 64)
+        d &= (1ull << width) - 1;
+    if(d == 0)
+        return false;
+    uint32_t l = 0;
+    while(l < 64 && (1ull << l) < d)
+        l++;
+    magic.shift = l;
+    magic.multiplier = 0;
+    if((d & (d - 1)) != 0){
+        unsigned __int128 all_ones = ~(unsigned __int128)0;
+        unsigned __int128 numerator = width + l == 128 ? all_ones : ((unsigned __int128)1 << (width + l)) - 1;
+        magic.multiplier = numerator / d + 1;
+        magic.shift = width + l;
+    }
+    return true;
+}
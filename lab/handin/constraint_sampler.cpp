@@ -0,0 +1,324 @@
+#include <spawn.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <cstdio>
+#include <cerrno>
+#include <sstream>
+#include "constraint_ir.hpp"
+#include "constraint_simplify.hpp"
+#include "constraint_bounds.hpp"
+#include "constraint_components.hpp"
+#include "constraint_to_verilog.hpp"
+#include "constraint_hash.hpp"
+#include "sample_server.hpp"
+#include "bitblast.hpp"
+
+extern char** environ;
+
+// 用yosys把Verilog综合成ASCII AIG: Verilog从标准输入送入, AIG从fd 3读回, 不经过中间文件.
+// yosys自己的输出转到标准错误, 不会混进样本输出.
+// 各部分并行编译时可能同时启动多个yosys, 管道带O_CLOEXEC, 子进程不会继承其他线程的管道而等不到EOF
+bool synthesizeAig(const std::string& yosys, const std::string& verilog, std::string& aig){
+    int in_pipe[2], aig_pipe[2];
+    if(pipe2(in_pipe, O_CLOEXEC) != 0)
+        return false;
+    if(pipe2(aig_pipe, O_CLOEXEC) != 0){
+        close(in_pipe[0]);
+        close(in_pipe[1]);
+        return false;
+    }
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, in_pipe[0], 0);
+    posix_spawn_file_actions_adddup2(&actions, 2, 1);
+    posix_spawn_file_actions_adddup2(&actions, aig_pipe[1], 3);
+    posix_spawn_file_actions_addclose(&actions, in_pipe[1]);
+    posix_spawn_file_actions_addclose(&actions, aig_pipe[0]);
+    std::string script = "read_verilog /dev/stdin; synth; aigmap; write_aiger -ascii /dev/fd/3";
+    std::vector<char*> args = {const_cast<char*>(yosys.c_str()), const_cast<char*>("-q"),
+                               const_cast<char*>("-p"), &script[0], nullptr};
+    pid_t pid;
+    int err = posix_spawnp(&pid, yosys.c_str(), &actions, nullptr, args.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    close(in_pipe[0]);
+    close(aig_pipe[1]);
+    if(err != 0){
+        std::cerr<<"Cannot run "<<yosys<<"\n";
+        close(in_pipe[1]);
+        close(aig_pipe[0]);
+        return false;
+    }
+
+    // 写Verilog和读AIG同时进行, 避免两边的管道都被写满
+    std::thread feeder([&]{
+        size_t sent = 0;
+        while(sent < verilog.size()){
+            ssize_t r = write(in_pipe[1], verilog.data() + sent, verilog.size() - sent);
+            if(r < 0 && errno == EINTR)
+                continue;
+            if(r <= 0)
+                break;
+            sent += r;
+        }
+        close(in_pipe[1]);
+    });
+    aig.clear();
+    char buf[1 << 16];
+    ssize_t r;
+    while((r = read(aig_pipe[0], buf, sizeof(buf))) != 0){
+        if(r < 0 && errno == EINTR)
+            continue;
+        if(r < 0)
+            break;
+        aig.append(buf, r);
+    }
+    close(aig_pipe[0]);
+    feeder.join();
+    int status;
+    while(waitpid(pid, &status, 0) < 0 && errno == EINTR);
+    if(!WIFEXITED(status) || WEXITSTATUS(status) != 0){
+        std::cerr<<yosys<<" failed\n";
+        return false;
+    }
+    return true;
+}
+
+// 编译流程的版本: 编译结果的含义改变时 (如新增的化简或位固定) 加一, 旧的缓存项随之失效
+const int PIPELINE_VERSION = 1;
+
+// 编译流程的名字, 作为缓存键的一部分
+std::string compilePipeline(const std::string& backend, const std::string& yosys){
+    return !yosys.empty() ? "synth;aigmap;" + yosys : backend;
+}
+
+// 编译约束: 命中缓存时直接加载采样DAG, 否则按backend构建:
+//   bdd: 约束按位直接构建BDD, 不经过网表
+//   aig: 约束先展开成AIG (指定yosys时经 Verilog -> yosys 得到AIG), 再构建BDD
+// 不经过yosys时, 约束直接给出的变量区间最先合取, 已知位不进入BDD而由path初值给出.
+// 不在BDD支撑集中的其余位 (没有约束的变量, 或被yosys优化掉的输入) 采样时直接随机填充.
+// BDD中所有解都取同一值的位在计数前就被取出, 同已知位一样由path初值给出
+bool compileConstraint(const ConstraintIR& ir, const std::string& backend, const std::string& yosys,
+                       const std::string& cache_dir, SampleDag& dag){
+    std::string cache_key, cache_filename;
+    if(!cache_dir.empty()){
+        // 文件名只是键的哈希, 完整的键写在文件里, 加载时比较, 哈希冲突或过期的文件都会重新构建
+        cache_key = constraint_key_text(ir, {compilePipeline(backend, yosys), "layout=hot",
+                                             "pipeline=" + std::to_string(PIPELINE_VERSION)});
+        cache_filename = cache_dir + "/" + constraint_key(cache_key) + ".sdag";
+        if(isDagFile(cache_filename)){
+            if(loadSampleDag(cache_filename, dag, &cache_key))
+                return true;
+            // 损坏的缓存项不算错误: 删掉后照常构建, 下面会写入新的
+            std::cerr<<"Rebuilding "<<cache_filename<<"\n";
+            unlink(cache_filename.c_str());
+            dag.clear();
+        }
+    }
+
+    if(!yosys.empty()){
+        std::string aig_text;
+        if(!synthesizeAig(yosys, constraint_to_verilog(ir), aig_text))
+            return false;
+        std::istringstream aig_in(aig_text);
+        if(!buildDagFromAig(aig_in, dag))
+            return false;
+    } else {
+        ConstraintBounds bounds = analyzeBounds(ir);
+        if(backend == "bdd" ? !buildDagFromIR(ir, &bounds, dag) : !buildDagFromAig(bitblastAig(ir, &bounds), dag))
+            return false;
+        // 已知位同样不在BDD的支撑集中, 但取值由path初值给定, 不是自由位
+        fixPathBits(dag, bounds.knownMask(), bounds.pathTemplate());
+    }
+    renumberHotPath(dag);
+
+    // 先写临时文件再改名, 并发运行时不会读到不完整的缓存
+    if(!cache_filename.empty()){
+        mkdir(cache_dir.c_str(), 0755);
+        std::string tmp_filename = cache_filename + "." + std::to_string(getpid());
+        if(saveSampleDag(dag, tmp_filename, cache_key))
+            rename(tmp_filename.c_str(), cache_filename.c_str());
+        else
+            unlink(tmp_filename.c_str());
+    }
+    return true;
+}
+
+// 化简后的约束按互相独立的各部分分别编译, 并行进行
+bool compileParts(const ConstraintIR& ir, const std::string& backend, const std::string& yosys, const std::string& cache_dir,
+                  int num_threads, CompiledConstraint& compiled){
+    for (const auto& var : ir.vars)
+        compiled.vars.push_back(VarLayout{var.first_bit + 1, var.width, var.name});
+    std::vector<ConstraintIR> parts = splitComponents(ir);
+    std::vector<std::unique_ptr<SampleDag>> dags(parts.size());
+    std::vector<char> ok(parts.size(), false);
+    std::atomic<size_t> next_part(0);
+    auto worker = [&]{
+        for(size_t i = next_part++; i < parts.size(); i = next_part++){
+            dags[i].reset(new SampleDag);
+            ok[i] = compileConstraint(parts[i], backend, yosys, cache_dir, *dags[i]);
+            if(ok[i])
+                buildJumpTables(*dags[i]);
+        }
+    };
+    std::vector<std::thread> workers;
+    for(int t = 0; t < std::min<int>(num_threads, parts.size()); t++)
+        workers.emplace_back(worker);
+    for(auto& w : workers)
+        w.join();
+    for(size_t i = 0; i < parts.size(); i++){
+        if(!ok[i])
+            return false;
+        compiled.dags.push_back(dags[i].get());
+        compiled.storage.push_back(std::move(dags[i]));
+    }
+    return true;
+}
+
+// 服务模式: 约束JSON解析并化简后按完整的约束键查找已编译的结果, 内容相同的约束只编译一次
+int serveConstraints(const std::string& socket_path, int argc, char* argv[]){
+    int num_workers = 4;
+    int num_threads = 1;
+    size_t max_cached = 16;
+    std::string backend = "bdd";
+    std::string yosys;
+    std::string cache_dir;
+    for(int i = 0; i < argc; i++){
+        std::string opt = argv[i];
+        if(opt == "--workers" && i + 1 < argc)
+            num_workers = std::max(1, std::stoi(argv[++i]));
+        else if(opt == "--threads" && i + 1 < argc)
+            num_threads = std::max(1, std::stoi(argv[++i]));
+        else if(opt == "--max-cached" && i + 1 < argc)
+            max_cached = std::max(1, std::stoi(argv[++i]));
+        else if(opt == "--backend" && i + 1 < argc && (std::string(argv[i + 1]) == "bdd" || std::string(argv[i + 1]) == "aig"))
+            backend = argv[++i];
+        else if(opt == "--yosys" && i + 1 < argc)
+            yosys = argv[++i];
+        else if(opt == "--cache-dir" && i + 1 < argc)
+            cache_dir = argv[++i];
+        else {
+            std::cerr << "Unknown option " << opt << "\n";
+            return 1;
+        }
+    }
+    // 只引用服务端缓存中仍在的结果, 不延长它们的生存期; 只在串行的编译回调中访问, 不需要加锁
+    std::unordered_map<std::string, std::weak_ptr<const CompiledConstraint>> by_content;
+    auto compile = [&](const std::string& input_filename, const std::string& map_filename, std::string& error)
+                       -> std::shared_ptr<const CompiledConstraint> {
+        if(!map_filename.empty()){
+            error = "--varmap is not used with constraint JSON";
+            return nullptr;
+        }
+        ConstraintIR ir;
+        if(!parseConstraintFile(input_filename, ir)){
+            error = "Cannot parse " + input_filename;
+            return nullptr;
+        }
+        simplifyConstraints(ir);
+        std::string key = constraint_key_text(ir, {compilePipeline(backend, yosys)});
+        for(auto it = by_content.begin(); it != by_content.end();)
+            it = it->second.expired() ? by_content.erase(it) : std::next(it);
+        auto it = by_content.find(key);
+        if(it != by_content.end()){
+            std::shared_ptr<const CompiledConstraint> cached = it->second.lock();
+            if(cached != nullptr)
+                return cached;
+        }
+        auto compiled = std::make_shared<CompiledConstraint>();
+        if(!compileParts(ir, backend, yosys, cache_dir, num_threads, *compiled)){
+            error = "Cannot compile " + input_filename;
+            return nullptr;
+        }
+        by_content[key] = compiled;
+        return compiled;
+    };
+    SampleServer server(compile, num_workers, num_threads, 4 * num_workers, max_cached);
+    return server.run(socket_path);
+}
+
+int main(int argc, char* argv[]) {
+
+    //server mode
+    if(argc >= 3 && std::string(argv[1]) == "--serve")
+        return serveConstraints(argv[2], argc - 3, argv + 3);
+
+    //input
+    std::string socket_path;
+    if(argc >= 3 && std::string(argv[1]) == "--connect"){
+        socket_path = argv[2];
+        argv += 2;
+        argc -= 2;
+    }
+    if(argc < 5) {
+        std::cerr << "Usage: " << argv[0] << " <constraint.json> <num_samples> <seed> <output_file>"
+                  << " [--backend bdd|aig] [--yosys <path>] [--cache-dir <dir>] [--compact] [--threads <n>] [--format json|ndjson|memh|bin]"
+                  << " [--fixed-report <file>]\n"
+                  << "  output_file may be - for stdout\n"
+                  << "  --fixed-report writes the bits every solution shares, per variable\n"
+                  << "       " << argv[0] << " --serve <socket> [--workers <n>] [--threads <n>] [--max-cached <n>] [--backend bdd|aig] [--yosys <path>]"
+                  << " [--cache-dir <dir>]\n"
+                  << "       " << argv[0] << " --connect <socket> <constraint.json> <num_samples> <seed> <output_file>"
+                  << " [--compact] [--format json|ndjson|memh|bin]\n";
+        return 1;
+    }
+    std::string constraint_filename = argv[1];
+    int num_samples = std::stoi(argv[2]);
+    unsigned seed = std::stoul(argv[3]);
+    std::string output_filename = argv[4];
+    std::string backend = "bdd";
+    std::string yosys;
+    std::string cache_dir;
+    bool compact = false;
+    std::string format_name = "json";
+    std::string fixed_report;
+    int num_threads = std::max(1u, std::thread::hardware_concurrency());
+    for(int i = 5; i < argc; i++){
+        std::string opt = argv[i];
+        if(opt == "--backend" && i + 1 < argc && (std::string(argv[i + 1]) == "bdd" || std::string(argv[i + 1]) == "aig"))
+            backend = argv[++i];
+        else if(opt == "--yosys" && i + 1 < argc)
+            yosys = argv[++i];
+        else if(opt == "--cache-dir" && i + 1 < argc)
+            cache_dir = argv[++i];
+        else if(opt == "--compact")
+            compact = true;
+        else if(opt == "--format" && i + 1 < argc)
+            format_name = argv[++i];
+        else if(opt == "--threads" && i + 1 < argc)
+            num_threads = std::max(1, std::stoi(argv[++i]));
+        else if(opt == "--fixed-report" && i + 1 < argc)
+            fixed_report = argv[++i];
+        else {
+            std::cerr << "Unknown option " << opt << "\n";
+            return 1;
+        }
+    }
+    if(!isFormatName(format_name)){
+        std::cerr << "Unknown format " << format_name << "\n";
+        return 1;
+    }
+    if(!socket_path.empty()){
+        if(backend != "bdd" || !yosys.empty() || !cache_dir.empty() || !fixed_report.empty()){
+            std::cerr << "--backend, --yosys, --cache-dir and --fixed-report are not available with --connect\n";
+            return 1;
+        }
+        std::string input_path;
+        if(!requestPath(constraint_filename, input_path))
+            return 1;
+        std::string request = input_path + " " + std::to_string(num_samples) + " " + std::to_string(seed)
+                              + " --format " + format_name + (compact ? " --compact" : "");
+        return requestSamples(socket_path, request, output_filename);
+    }
+
+    ConstraintIR ir;
+    if(!parseConstraintFile(constraint_filename, ir))
+        return 1;
+    simplifyConstraints(ir);
+    CompiledConstraint compiled;
+    if(!compileParts(ir, backend, yosys, cache_dir, num_threads, compiled))
+        return 1;
+    if(!fixed_report.empty() && !writeFixedReport(compiled.dags, compiled.vars, fixed_report))
+        return 1;
+
+    return writeOutput(compiled.dags, compiled.vars, format_name, compact, num_samples, seed, num_threads, output_filename);
+}
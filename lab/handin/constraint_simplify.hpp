@@ -0,0 +1,608 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <unordered_map>
+#include <unordered_set>
+#include "constraint_ir.hpp"
+#include "bitblaster.hpp"
+
+// 每一位都是常量的Logic, 用于折叠常量子表达式
+struct ConstLogic{
+    using Lit = char;
+    static const bool has_shapes = false;
+
+    Lit zero() const { return false; }
+    Lit one() const { return true; }
+    Lit input(uint32_t) const { return false; }
+    Lit Not(Lit a) const { return !a; }
+    Lit And(Lit a, Lit b) const { return a && b; }
+    Lit Or(Lit a, Lit b) const { return a || b; }
+    Lit Xor(Lit a, Lit b) const { return a != b; }
+    Lit Mux(Lit s, Lit t, Lit e) const { return s ? t : e; }
+    bool buildShape(const VarShape&, const Variable&, Lit&) const {
+        return false;
+    }
+};
+
+// 常量的Verilog写法, 如 16'h39dd, 8'sh80
+std::string constantText(const Constant& c){
+    static const char* digits = "0123456789abcdef";
+    std::string hex;
+    for(uint32_t i = 0; i < c.width; i += 4){
+        int digit = 0;
+        for(uint32_t j = 0; j < 4 && i + j < c.width; j++)
+            digit |= c.bit(i + j) << j;
+        hex += digits[digit];
+    }
+    while(hex.size() > 1 && hex.back() == '0')
+        hex.pop_back();
+    return std::to_string(c.width) + (c.is_signed ? "'sh" : "'h") + std::string(hex.rbegin(), hex.rend());
+}
+
+Constant makeConstant(const std::vector<char>& bits, bool is_signed){
+    Constant c;
+    c.width = bits.size();
+    c.is_signed = is_signed;
+    c.words.assign((c.width + 63) / 64, 0);
+    for(uint32_t i = 0; i < c.width; i++)
+        if(bits[i])
+            c.words[i / 64] |= 1ull << (i % 64);
+    return c;
+}
+
+// 取出roots这些约束, 只保留从它们可达的节点和常量 (除法节点本身也带有除数非零的条件, 不能留下不可达的除法)
+ConstraintIR extractConstraints(const ConstraintIR& ir, const std::vector<uint32_t>& roots){
+    ConstraintIR pruned;
+    pruned.vars = ir.vars;
+    pruned.num_bits = ir.num_bits;
+    IRBuilder builder(pruned);
+    std::vector<uint32_t> index(ir.nodes.size(), NO_NODE);
+    std::vector<uint32_t> stack(roots.rbegin(), roots.rend());
+    while(!stack.empty()){
+        uint32_t i = stack.back();
+        ExprNode node = ir.nodes[i];
+        if(index[i] != NO_NODE){
+            stack.pop_back();
+            continue;
+        }
+        // 子节点先于父节点加入
+        bool ready = true;
+        for(uint32_t child : {node.lhs, node.rhs}){
+            if(child != NO_NODE && index[child] == NO_NODE){
+                stack.push_back(child);
+                ready = false;
+            }
+        }
+        if(!ready)
+            continue;
+        stack.pop_back();
+        if(node.op == Op::CONST)
+            node.ref = builder.constant(ir.constants[node.ref], ir.constant_text[node.ref]);
+        if(node.lhs != NO_NODE)
+            node.lhs = index[node.lhs];
+        if(node.rhs != NO_NODE)
+            node.rhs = index[node.rhs];
+        index[i] = builder.node(node);
+    }
+    for(uint32_t root : roots)
+        pruned.constraints.push_back(index[root]);
+    return pruned;
+}
+
+void prune(ConstraintIR& ir){
+    ir = extractConstraints(ir, ir.constraints);
+}
+
+// 约束化简. 每个子表达式在它的位宽上下文 (width, is_signed) 中改写, 结果与原约束等价:
+//   - 不含变量的子表达式折叠成上下文位宽的常量 (其中的除数在自身位宽和上下文位宽下都须非零)
+//   - 连续的加减常量合并: (e - c1) + c2 -> e + (c2 - c1), 加0去掉
+//   - 常量移位: 移位量为0时去掉, 不小于位宽时为0, 连续的同向常量移位合并
+//   - ~~e, -(-e) 去掉
+//   - 顶层的 && 拆成多个约束, 恒真的约束删除
+// 改写后子表达式的自决定位宽不小于原来的、不大于上下文位宽, 所以外层的位宽不变. 含变量的子表达式
+// 总在无符号的上下文中求值 (变量无符号). 除法的除数原样保留, 使生成的除数非零条件不变;
+// 被删除的部分中的除法, 其除数非零条件作为单独的约束保留
+class ConstraintSimplifier{
+public:
+    ConstraintSimplifier(const ConstraintIR& in, ConstraintIR& out)
+        : in(in), out(out), builder(out), blaster(logic, in), has_var(in.nodes.size()), has_div(in.nodes.size()) {
+        inferSelfTypes(in, in_width, in_signed);
+        for(uint32_t i = 0; i < in.nodes.size(); i++){
+            const ExprNode& node = in.nodes[i];
+            has_var[i] = node.op == Op::VAR;
+            has_div[i] = node.op == Op::DIV;
+            for(uint32_t child : {node.lhs, node.rhs}){
+                if(child != NO_NODE){
+                    has_var[i] = has_var[i] || has_var[child];
+                    has_div[i] = has_div[i] || has_div[child];
+                }
+            }
+        }
+    }
+
+    void run(){
+        out.vars = in.vars;
+        out.num_bits = in.num_bits;
+        for(uint32_t root : in.constraints)
+            simplifyRoot(root);
+        prune(out);
+    }
+
+private:
+    void simplifyRoot(uint32_t index){
+        const ExprNode& node = in.nodes[index];
+        if(node.op == Op::LOG_AND){
+            simplifyRoot(node.lhs);
+            simplifyRoot(node.rhs);
+            return;
+        }
+        // a -> b 与 a || b 中一侧恒真时整个约束恒真
+        if(node.op == Op::IMPLY || node.op == Op::LOG_OR){
+            for(int side = 0; side < 2; side++){
+                uint32_t operand = side == 0 ? node.lhs : node.rhs;
+                uint32_t other = side == 0 ? node.rhs : node.lhs;
+                int value = constantTruth(simplifySelf(operand));
+                if(value == (node.op == Op::IMPLY && side == 0 ? 0 : 1)){
+                    keepGuards(other);
+                    return;
+                }
+            }
+        }
+        uint32_t result = simplifySelf(index);
+        if(constantTruth(result) == 1)
+            return;
+        addConstraint(result);
+    }
+
+    void addConstraint(uint32_t node){
+        if(roots.insert(node).second)
+            out.constraints.push_back(node);
+    }
+
+    // 常量节点的真值, 非常量时为-1
+    int constantTruth(uint32_t node) const {
+        if(out.nodes[node].op != Op::CONST)
+            return -1;
+        for(uint64_t word : out.constants[out.nodes[node].ref].words)
+            if(word != 0)
+                return 1;
+        return 0;
+    }
+
+    // 被删除的子表达式中的除法: 保留除数非零的条件
+    void keepGuards(uint32_t index){
+        if(!has_div[index] || !guarded.insert(index).second)
+            return;
+        const ExprNode& node = in.nodes[index];
+        if(node.op == Op::DIV && (has_var[node.rhs] || isZero(node.rhs, in_width[node.rhs], in_signed[node.rhs])))
+            addConstraint(copy(node.rhs));
+        for(uint32_t child : {node.lhs, node.rhs})
+            if(child != NO_NODE)
+                keepGuards(child);
+    }
+
+    uint32_t simplifySelf(uint32_t index){
+        return simplify(index, in_width[index], in_signed[index]);
+    }
+
+    uint32_t simplify(uint32_t index, uint32_t width, bool is_signed){
+        const ExprNode& node = in.nodes[index];
+        if(isBoolean(node.op)){
+            width = 1;
+            is_signed = false;
+        }
+        uint64_t key = (uint64_t)index << 33 | (uint64_t)width << 1 | is_signed;
+        auto it = memo.find(key);
+        if(it != memo.end())
+            return it->second;
+        uint32_t result = !has_var[index] && divisionsSafe(index, width, is_signed)
+                        ? fold(index, width, is_signed) : rewrite(index, width, is_signed);
+        memo.emplace(key, result);
+        return result;
+    }
+
+    // 常量子表达式中每个除数在所处的上下文和自身位宽下都非零, 折叠后才与原式 (含除数非零条件) 等价
+    bool divisionsSafe(uint32_t index, uint32_t width, bool is_signed){
+        const ExprNode& node = in.nodes[index];
+        if(!has_div[index])
+            return true;
+        if(node.op == Op::DIV && (isZero(node.rhs, width, is_signed) || isZero(node.rhs, in_width[node.rhs], in_signed[node.rhs])))
+            return false;
+        bool safe = true;
+        forChildren(index, width, is_signed, [&](uint32_t child, uint32_t w, bool s){
+            safe = safe && divisionsSafe(child, w, s);
+        });
+        return safe;
+    }
+
+    bool isZero(uint32_t index, uint32_t width, bool is_signed){
+        for(char bit : blaster.eval(index, width, is_signed))
+            if(bit)
+                return false;
+        return true;
+    }
+
+    uint32_t fold(uint32_t index, uint32_t width, bool is_signed){
+        std::vector<char> bits = blaster.eval(index, width, is_signed);
+        return constantNode(makeConstant(bits, in_signed[index]));
+    }
+
+    uint32_t constantNode(const Constant& c){
+        return constantNode(c, constantText(c));
+    }
+    uint32_t constantNode(const Constant& c, const std::string& text){
+        ExprNode node;
+        node.op = Op::CONST;
+        node.ref = builder.constant(c, text);
+        return add(node);
+    }
+
+    uint32_t add(const ExprNode& node){
+        uint32_t index = builder.node(node);
+        if(index >= out_width.size())
+            inferSelfType(out, index, out_width, out_signed);
+        return index;
+    }
+
+    uint32_t add(Op op, uint32_t lhs, uint32_t rhs = NO_NODE){
+        ExprNode node;
+        node.op = op;
+        node.lhs = lhs;
+        node.rhs = rhs;
+        return add(node);
+    }
+
+    // 原样复制子表达式
+    uint32_t copy(uint32_t index){
+        auto it = copies.find(index);
+        if(it != copies.end())
+            return it->second;
+        ExprNode node = in.nodes[index];
+        uint32_t result;
+        if(node.op == Op::CONST){
+            result = constantNode(in.constants[node.ref], in.constant_text[node.ref]);
+        } else {
+            if(node.lhs != NO_NODE)
+                node.lhs = copy(node.lhs);
+            if(node.rhs != NO_NODE)
+                node.rhs = copy(node.rhs);
+            result = add(node);
+        }
+        copies.emplace(index, result);
+        return result;
+    }
+
+    // 子表达式及其上下文, 规则同BitBlaster
+    template<class Visit>
+    void forChildren(uint32_t index, uint32_t width, bool is_signed, Visit visit){
+        const ExprNode& node = in.nodes[index];
+        switch(node.op){
+            case Op::VAR: case Op::CONST:
+                break;
+            case Op::BIT_NEG: case Op::MINUS:
+                visit(node.lhs, width, is_signed);
+                break;
+            case Op::LOG_NEG:
+                visit(node.lhs, in_width[node.lhs], in_signed[node.lhs]);
+                break;
+            case Op::LOG_AND: case Op::LOG_OR: case Op::IMPLY:
+                visit(node.lhs, in_width[node.lhs], in_signed[node.lhs]);
+                visit(node.rhs, in_width[node.rhs], in_signed[node.rhs]);
+                break;
+            case Op::LSHIFT: case Op::RSHIFT:
+                visit(node.lhs, width, is_signed);
+                visit(node.rhs, in_width[node.rhs], in_signed[node.rhs]);
+                break;
+            case Op::EQ: case Op::NEQ: case Op::LT: case Op::LTE: case Op::GT: case Op::GTE: {
+                uint32_t operand_width = std::max(in_width[node.lhs], in_width[node.rhs]);
+                bool operand_signed = in_signed[node.lhs] && in_signed[node.rhs];
+                visit(node.lhs, operand_width, operand_signed);
+                visit(node.rhs, operand_width, operand_signed);
+                break;
+            }
+            default:
+                visit(node.lhs, width, is_signed);
+                visit(node.rhs, width, is_signed);
+        }
+    }
+
+    uint32_t rewrite(uint32_t index, uint32_t width, bool is_signed){
+        const ExprNode& node = in.nodes[index];
+        // 有符号的上下文中只有常量; 到这里说明其中有除数为零, 约束不可满足, 原样保留
+        if(is_signed)
+            return copy(index);
+        switch(node.op){
+            case Op::VAR:
+                return add(node);
+            case Op::CONST:
+                return copy(index);
+            case Op::BIT_NEG: case Op::MINUS: {
+                uint32_t a = simplify(node.lhs, width, is_signed);
+                if(out.nodes[a].op == node.op)
+                    return out.nodes[a].lhs;
+                return add(node.op, a);
+            }
+            case Op::ADD: case Op::SUB:
+                return addSub(node.op, simplify(node.lhs, width, is_signed), simplify(node.rhs, width, is_signed), width);
+            case Op::DIV: {
+                // 除数原样保留, 生成的除数非零条件与原式相同. 常量除数在上下文中与按自身位宽同为零或同为非零时,
+                // 可以折叠成上下文位宽的常量
+                bool fold_divisor = !has_var[node.rhs] && divisionsSafe(node.rhs, width, is_signed)
+                                    && isZero(node.rhs, width, is_signed) == isZero(node.rhs, in_width[node.rhs], in_signed[node.rhs]);
+                return add(Op::DIV, simplify(node.lhs, width, is_signed), fold_divisor ? fold(node.rhs, width, is_signed) : copy(node.rhs));
+            }
+            case Op::LSHIFT: case Op::RSHIFT:
+                return shift(index, simplify(node.lhs, width, is_signed), width);
+            default: {
+                uint32_t children[2] = {NO_NODE, NO_NODE};
+                int n = 0;
+                forChildren(index, width, is_signed, [&](uint32_t child, uint32_t w, bool s){
+                    children[n++] = simplify(child, w, s);
+                });
+                return add(node.op, children[0], children[1]);
+            }
+        }
+    }
+
+    // 上下文中的常量值 (含变量的上下文无符号, 常量零扩展)
+    std::vector<char> constBits(uint32_t node, uint32_t width) const {
+        const Constant& c = out.constants[out.nodes[node].ref];
+        std::vector<char> bits(width);
+        for(uint32_t i = 0; i < width && i < c.width; i++)
+            bits[i] = c.bit(i);
+        return bits;
+    }
+
+    static std::vector<char> addBits(const std::vector<char>& a, std::vector<char> b, bool subtract){
+        bool carry = subtract;
+        for(size_t i = 0; i < a.size(); i++){
+            bool bi = b[i] != subtract;
+            b[i] = (a[i] != bi) != carry;
+            carry = (a[i] && bi) || (carry && (a[i] != bi));
+        }
+        return b;
+    }
+
+    uint32_t addSub(Op op, uint32_t a, uint32_t b, uint32_t width){
+        if(op == Op::ADD && out.nodes[a].op == Op::CONST && out.nodes[b].op != Op::CONST)
+            std::swap(a, b);
+        if(out.nodes[b].op != Op::CONST)
+            return add(op, a, b);
+        // e ± k: 与e中的常量合并
+        std::vector<char> k = constBits(b, width);
+        if(op == Op::SUB)
+            k = addBits(std::vector<char>(width), k, true);
+        const ExprNode& inner = out.nodes[a];
+        if((inner.op == Op::ADD || inner.op == Op::SUB) && out.nodes[inner.rhs].op == Op::CONST){
+            k = addBits(k, constBits(inner.rhs, width), inner.op == Op::SUB);
+            a = inner.lhs;
+        }
+        bool zero = true;
+        for(char bit : k)
+            zero = zero && !bit;
+        if(zero && out_width[a] == width)
+            return a;
+        // 常量取负后更短时写成减法
+        bool negative = width > 0 && k[width - 1];
+        if(negative)
+            k = addBits(std::vector<char>(width), k, true);
+        return add(negative ? Op::SUB : Op::ADD, a, constantNode(makeConstant(k, false)));
+    }
+
+    uint32_t shift(uint32_t index, uint32_t a, uint32_t width){
+        const ExprNode& node = in.nodes[index];
+        if(has_var[node.rhs])
+            return add(node.op, a, simplify(node.rhs, in_width[node.rhs], in_signed[node.rhs]));
+        // 移位量按无符号处理
+        std::vector<char> bits = blaster.eval(node.rhs, in_width[node.rhs], in_signed[node.rhs]);
+        uint64_t amount = 0;
+        for(size_t i = 0; i < bits.size(); i++)
+            if(bits[i])
+                amount = i >= 32 ? UINT32_MAX : std::min<uint64_t>(UINT32_MAX, amount + (1ull << i));
+        keepGuards(node.rhs);
+        if(amount >= width){
+            keepGuards(node.lhs);
+            return constantNode(makeConstant(std::vector<char>(width), false));
+        }
+        if(amount == 0)
+            return a;
+        const ExprNode& inner = out.nodes[a];
+        if(inner.op != node.op || out.nodes[inner.rhs].op != Op::CONST || out.constants[out.nodes[inner.rhs].ref].width > 32)
+            return add(node.op, a, simplify(node.rhs, in_width[node.rhs], in_signed[node.rhs]));
+        amount = std::min<uint64_t>(UINT32_MAX, amount + out.constants[out.nodes[inner.rhs].ref].words[0]);
+        a = inner.lhs;
+        std::vector<char> amount_bits(32);
+        for(int i = 0; i < 32; i++)
+            amount_bits[i] = amount >> i & 1;
+        return add(node.op, a, constantNode(makeConstant(amount_bits, false)));
+    }
+
+    const ConstraintIR& in;
+    ConstraintIR& out;
+    IRBuilder builder;
+    ConstLogic logic;
+    BitBlaster<ConstLogic> blaster;
+    std::vector<char> has_var;
+    std::vector<char> has_div;
+    std::vector<uint32_t> in_width, out_width;
+    std::vector<char> in_signed, out_signed;
+    std::unordered_map<uint64_t, uint32_t> memo;
+    std::unordered_map<uint32_t, uint32_t> copies;
+    std::unordered_set<uint32_t> roots;
+    std::unordered_set<uint32_t> guarded;
+};
+
+// 位宽收窄. Verilog按操作数中最宽者 (常常是一个很宽的常量, 如 16'h39dd 与14位变量相加) 确定上下文位宽,
+// 其中的加法器、比较器的高位常常恒为0. 对每个上下文 (同一位宽下求值的一组子表达式) 求出其中每个值
+// 实际可能用到的位数 (值宽):
+//   变量: 位宽; 常量: 有效位数; a + b: max + 1; a * b: 两者之和; a & b: min; a | b, a ^ b: max;
+//   a << 常量k: a + k; a >> n, a / b: a; 比较和逻辑运算: 1; 减法、取负、按位取反: 上下文位宽
+// 上下文中所有值宽都不超过m时, 每个子表达式在m位上求值与在原位宽上求值相同, 于是把其中的常量都写成m位,
+// 上下文位宽即收窄为m. 有符号的上下文和含除法的上下文 (除数非零条件按除数自身的位宽求值) 保持不变
+class WidthNarrower{
+public:
+    WidthNarrower(const ConstraintIR& in, ConstraintIR& out) : in(in), out(out), builder(out) {
+        inferSelfTypes(in, in_width, in_signed);
+    }
+
+    void run(){
+        out.vars = in.vars;
+        out.num_bits = in.num_bits;
+        for(uint32_t root : in.constraints){
+            uint32_t node = narrowSelf(root);
+            if(roots.insert(node).second)
+                out.constraints.push_back(node);
+        }
+    }
+
+private:
+    // 自决定位宽的子表达式自成一个上下文
+    uint32_t narrowSelf(uint32_t index){
+        uint32_t width = in_width[index];
+        if(!in_signed[index] && !isBoolean(in.nodes[index].op))
+            width = contextWidth({index}, width);
+        return rebuild(index, width, width < in_width[index]);
+    }
+
+    // 上下文中所有值宽的最大值; 上下文不能收窄时为原位宽
+    uint32_t contextWidth(std::initializer_list<uint32_t> tops, uint32_t width){
+        uint32_t needed = 1;
+        bool fixed = false;
+        std::unordered_set<uint32_t> visited;
+        for(uint32_t top : tops)
+            scan(top, width, needed, fixed, visited);
+        return fixed ? width : needed;
+    }
+
+    // 返回index的值宽, 同时更新上下文中值宽的最大值
+    uint32_t scan(uint32_t index, uint32_t width, uint32_t& needed, bool& fixed, std::unordered_set<uint32_t>& visited){
+        const ExprNode& node = in.nodes[index];
+        uint64_t value_width = width;
+        switch(node.op){
+            case Op::VAR:
+                value_width = in.vars[node.ref].width;
+                break;
+            case Op::CONST: {
+                const Constant& c = in.constants[node.ref];
+                value_width = 1;
+                for(uint32_t i = c.width; i-- > 0;){
+                    if(c.bit(i)){
+                        value_width = i + 1;
+                        break;
+                    }
+                }
+                break;
+            }
+            case Op::ADD: case Op::MUL: case Op::BIT_AND: case Op::BIT_OR: case Op::BIT_XOR: {
+                uint64_t a = scan(node.lhs, width, needed, fixed, visited);
+                uint64_t b = scan(node.rhs, width, needed, fixed, visited);
+                value_width = node.op == Op::ADD ? std::max(a, b) + 1 : node.op == Op::MUL ? a + b
+                            : node.op == Op::BIT_AND ? std::min(a, b) : std::max(a, b);
+                break;
+            }
+            case Op::SUB:
+                scan(node.lhs, width, needed, fixed, visited);
+                scan(node.rhs, width, needed, fixed, visited);
+                break;
+            case Op::MINUS: case Op::BIT_NEG:
+                scan(node.lhs, width, needed, fixed, visited);
+                break;
+            case Op::DIV:
+                fixed = true;
+                break;
+            case Op::LSHIFT: case Op::RSHIFT: {
+                uint64_t a = scan(node.lhs, width, needed, fixed, visited);
+                value_width = node.op == Op::RSHIFT ? a : width;
+                const ExprNode& amount = in.nodes[node.rhs];
+                if(node.op == Op::LSHIFT && amount.op == Op::CONST && in.constants[amount.ref].width <= 32)
+                    value_width = a + in.constants[amount.ref].words[0];
+                break;
+            }
+            default:
+                value_width = 1;
+        }
+        uint32_t result = std::min<uint64_t>(value_width, width);
+        if(visited.insert(index).second)
+            needed = std::max(needed, result);
+        return result;
+    }
+
+    // 在位宽width的上下文中重建index; narrowed时上下文中的常量都写成width位
+    uint32_t rebuild(uint32_t index, uint32_t width, bool narrowed){
+        uint64_t key = (uint64_t)index << 33 | (uint64_t)width << 1 | narrowed;
+        auto it = memo.find(key);
+        if(it != memo.end())
+            return it->second;
+        ExprNode node = in.nodes[index];
+        switch(node.op){
+            case Op::VAR:
+                break;
+            case Op::CONST: {
+                Constant c = in.constants[node.ref];
+                if(narrowed && c.width != width){
+                    c.width = width;
+                    c.is_signed = false;
+                    c.words.resize((width + 63) / 64);
+                    if(width % 64 != 0)
+                        c.words.back() &= (1ull << (width % 64)) - 1;
+                    node.ref = builder.constant(c, constantText(c));
+                } else {
+                    node.ref = builder.constant(c, in.constant_text[node.ref]);
+                }
+                break;
+            }
+            case Op::LOG_NEG:
+                node.lhs = narrowSelf(node.lhs);
+                break;
+            case Op::LOG_AND: case Op::LOG_OR: case Op::IMPLY:
+                node.lhs = narrowSelf(node.lhs);
+                node.rhs = narrowSelf(node.rhs);
+                break;
+            case Op::LSHIFT: case Op::RSHIFT:
+                node.lhs = rebuild(node.lhs, width, narrowed);
+                node.rhs = narrowSelf(node.rhs);
+                break;
+            case Op::EQ: case Op::NEQ: case Op::LT: case Op::LTE: case Op::GT: case Op::GTE: {
+                // 两个操作数同在一个上下文中
+                uint32_t operand_width = std::max(in_width[node.lhs], in_width[node.rhs]);
+                uint32_t needed = operand_width;
+                if(!in_signed[node.lhs] || !in_signed[node.rhs])
+                    needed = contextWidth({node.lhs, node.rhs}, operand_width);
+                node.lhs = rebuild(node.lhs, needed, needed < operand_width);
+                node.rhs = rebuild(node.rhs, needed, needed < operand_width);
+                break;
+            }
+            default:
+                node.lhs = rebuild(node.lhs, width, narrowed);
+                if(node.rhs != NO_NODE)
+                    node.rhs = rebuild(node.rhs, width, narrowed);
+        }
+        uint32_t result = builder.node(node);
+        memo.emplace(key, result);
+        return result;
+    }
+
+    const ConstraintIR& in;
+    ConstraintIR& out;
+    IRBuilder builder;
+    std::vector<uint32_t> in_width;
+    std::vector<char> in_signed;
+    std::unordered_map<uint64_t, uint32_t> memo;
+    std::unordered_set<uint32_t> roots;
+};
+
+void narrowWidths(ConstraintIR& ir){
+    ConstraintIR out;
+    WidthNarrower(ir, out).run();
+    ir = std::move(out);
+}
+
+// 化简后再收窄位宽
+void simplifyConstraints(ConstraintIR& ir){
+    ConstraintIR out;
+    ConstraintSimplifier(ir, out).run();
+    ir = std::move(out);
+    narrowWidths(ir);
+}
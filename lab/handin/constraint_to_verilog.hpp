@@ -0,0 +1,284 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include "constraint_ir.hpp"
+
+// 变量声明
+void generate_variable_declarations(const ConstraintIR& ir, std::string& out) {
+    for (const auto& var : ir.vars) {
+        out += "    input [" + std::to_string(var.width - 1) + ":0] " + var.name + ",\n";
+    }
+    out += "    output result\n";
+}
+
+// 生成Verilog约束, 全部写入同一个缓冲区.
+// IR中结构相同的子表达式已合并, 同一子表达式在相同的位宽上下文中被多次使用 (包括除数与它的非零条件)
+// 时只生成一次, 作为一个命名的wire. wire的位宽就是上下文的位宽, 在原处引用它不改变表达式的位宽和值;
+// 有符号的上下文只出现在全由常量组成的表达式中, 不生成wire.
+// 除以常量写成乘法和移位, 不让综合出除法器: 乘积需要更宽的上下文, 所以商和被除数各占一个wire,
+// 在商的wire里按宽位计算后截断; 除以2的幂直接右移. 非零常量除数不生成非零条件
+class VerilogEmitter {
+public:
+    VerilogEmitter(const ConstraintIR& ir, std::string& out) : ir(ir), out(out) {
+        inferSelfTypes(ir, self_width, self_signed);
+    }
+
+    void generate_constraints() {
+        for (uint32_t constraint : ir.constraints)
+            countSelf(constraint);
+
+        int constraint_count = 0;
+        for (uint32_t constraint : ir.constraints) {
+            declareSelf(constraint);
+            std::string name = "cnstr" + std::to_string(constraint_count++);
+            out += "    wire " + name + ";\n";
+            out += "    assign " + name + " = |(";
+            writeSelf(constraint);
+            out += ");\n";
+        }
+        // 除数另外要求非零
+        for (uint32_t divide : divides) {
+            declareSelf(ir.nodes[divide].rhs);
+            std::string name = "cnstrDIV" + std::to_string(constraint_count++);
+            out += "    wire " + name + ";\n";
+            out += "    assign " + name + " = |(";
+            writeSelf(ir.nodes[divide].rhs);
+            out += ");\n";
+        }
+        out += "    assign result = ";
+        if (constraint_count == 0)
+            out += "1'b1";
+        for (int i = 0; i < constraint_count; i++) {
+            if (i > 0)
+                out += " & ";
+            out += (i < (int)ir.constraints.size() ? "cnstr" : "cnstrDIV") + std::to_string(i);
+        }
+        out += ";\n";
+    }
+
+private:
+    struct Use {
+        uint32_t count = 0;
+        bool forced = false;        // 只引用一次也要生成wire
+        bool declared = false;
+        int wire = -1;
+    };
+
+    // 比较和逻辑运算的结果与上下文无关, 统一按1位无符号的上下文计
+    uint64_t key(uint32_t index, uint32_t& width, bool& is_signed) const {
+        if (isBoolean(ir.nodes[index].op)) {
+            width = 1;
+            is_signed = false;
+        }
+        return (uint64_t)index << 33 | (uint64_t)width << 1 | is_signed;
+    }
+
+    // 按生成时的顺序访问子表达式及其上下文
+    template<class Visit>
+    void children(uint32_t index, uint32_t width, bool is_signed, Visit visit) {
+        const ExprNode& expr = ir.nodes[index];
+        switch (expr.op) {
+        case Op::VAR: case Op::CONST:
+            break;
+        case Op::BIT_NEG: case Op::MINUS:
+            visit(expr.lhs, width, is_signed);
+            break;
+        case Op::LOG_NEG:
+            visit(expr.lhs, self_width[expr.lhs], self_signed[expr.lhs]);
+            break;
+        case Op::LOG_AND: case Op::LOG_OR: case Op::IMPLY:
+            visit(expr.lhs, self_width[expr.lhs], self_signed[expr.lhs]);
+            visit(expr.rhs, self_width[expr.rhs], self_signed[expr.rhs]);
+            break;
+        case Op::LSHIFT: case Op::RSHIFT:
+            visit(expr.lhs, width, is_signed);
+            visit(expr.rhs, self_width[expr.rhs], self_signed[expr.rhs]);
+            break;
+        case Op::EQ: case Op::NEQ: case Op::LT: case Op::LTE: case Op::GT: case Op::GTE: {
+            uint32_t operand_width = std::max(self_width[expr.lhs], self_width[expr.rhs]);
+            bool operand_signed = self_signed[expr.lhs] && self_signed[expr.rhs];
+            visit(expr.lhs, operand_width, operand_signed);
+            visit(expr.rhs, operand_width, operand_signed);
+            break;
+        }
+        default:
+            visit(expr.lhs, width, is_signed);
+            visit(expr.rhs, width, is_signed);
+        }
+    }
+
+    // 第一遍: 统计每个 (子表达式, 上下文) 被引用的次数, 并按出现顺序记下除法
+    void count(uint32_t index, uint32_t width, bool is_signed) {
+        Use& use = uses[key(index, width, is_signed)];
+        if (use.count++ > 0)
+            return;
+        const ExprNode& expr = ir.nodes[index];
+        if (expr.op == Op::DIV) {
+            DivMagic magic;
+            if (divisionMagic(ir, expr.rhs, width, is_signed, magic) && magic.multiplier != 0) {
+                use.forced = true;
+                uint32_t lhs_width = width;
+                bool lhs_signed = is_signed;
+                if (ir.nodes[expr.lhs].op != Op::VAR && ir.nodes[expr.lhs].op != Op::CONST)
+                    uses[key(expr.lhs, lhs_width, lhs_signed)].forced = true;
+            }
+            count(expr.rhs, width, is_signed);
+            if (divide_seen.insert(index).second && !isNonzeroConstant(ir, expr.rhs)) {
+                divides.push_back(index);
+                countSelf(expr.rhs);
+            }
+            count(expr.lhs, width, is_signed);
+            return;
+        }
+        children(index, width, is_signed, [this](uint32_t child, uint32_t w, bool s) { count(child, w, s); });
+    }
+    void countSelf(uint32_t index) {
+        count(index, self_width[index], self_signed[index]);
+    }
+
+    // 第二遍: 先声明子表达式用到的wire, 再声明自己的
+    void declare(uint32_t index, uint32_t width, bool is_signed) {
+        Use& use = uses[key(index, width, is_signed)];
+        if (use.declared)
+            return;
+        use.declared = true;
+        children(index, width, is_signed, [this](uint32_t child, uint32_t w, bool s) { declare(child, w, s); });
+        const ExprNode& expr = ir.nodes[index];
+        if ((use.count < 2 && !use.forced) || expr.op == Op::VAR || expr.op == Op::CONST || is_signed)
+            return;
+        std::string name = "cnstrWire" + std::to_string(num_wires);
+        out += width == 1 ? "    wire " : "    wire [" + std::to_string(width - 1) + ":0] ";
+        out += name + ";\n";
+        out += "    assign " + name + " = ";
+        writeExpr(index, width, is_signed);
+        out += ";\n";
+        use.wire = num_wires++;
+    }
+    void declareSelf(uint32_t index) {
+        declare(index, self_width[index], self_signed[index]);
+    }
+
+    void write(uint32_t index, uint32_t width, bool is_signed) {
+        const Use& use = uses[key(index, width, is_signed)];
+        if (use.wire >= 0)
+            out += "cnstrWire" + std::to_string(use.wire);
+        else
+            writeExpr(index, width, is_signed);
+    }
+    void writeSelf(uint32_t index) {
+        write(index, self_width[index], self_signed[index]);
+    }
+
+    // 子表达式的上下文由children给出
+    void writeExpr(uint32_t index, uint32_t width, bool is_signed) {
+        const ExprNode& expr = ir.nodes[index];
+        switch (expr.op) {
+        // 变量或常量
+        case Op::VAR:
+            out += ir.vars[expr.ref].name;
+            return;
+        case Op::CONST:
+            out += ir.constant_text[expr.ref];
+            return;
+        // 一元操作符
+        case Op::LOG_NEG: case Op::BIT_NEG: case Op::MINUS:
+            out += expr.op == Op::LOG_NEG ? "!(" : expr.op == Op::BIT_NEG ? "~(" : "-(";
+            children(index, width, is_signed, [this](uint32_t child, uint32_t w, bool s) { write(child, w, s); });
+            out += ")";
+            return;
+        case Op::DIV: {
+            DivMagic magic;
+            if (!divisionMagic(ir, expr.rhs, width, is_signed, magic)) {
+                writeBinary(index, width, is_signed);
+                return;
+            }
+            out += "(";
+            write(expr.lhs, width, is_signed);
+            if (magic.multiplier != 0) {
+                // 乘积的位宽: 被除数加上乘数的位数
+                uint32_t m_width = 0;
+                while (m_width < 128 && (magic.multiplier >> m_width) != 0)
+                    m_width++;
+                out += " * " + hexConstant(magic.multiplier, width + m_width) + ")";
+            }
+            out += " >> " + std::to_string(magic.shift);
+            if (magic.multiplier == 0)
+                out += ")";
+            return;
+        }
+        case Op::IMPLY:
+            out += "(!(";
+            writeSelf(expr.lhs);
+            out += ") || ";
+            writeSelf(expr.rhs);
+            out += ")";
+            return;
+        // 二元操作符
+        default:
+            writeBinary(index, width, is_signed);
+        }
+    }
+
+    void writeBinary(uint32_t index, uint32_t width, bool is_signed) {
+        static const char* const symbols[] = {
+            "", "", "",
+            " + ", " - ", " * ", " / ",
+            " && ", " || ", "",
+            " == ", " != ", " < ", " <= ", " > ", " >= ",
+            " & ", " | ", " ^ ",
+            " >> ", " << "
+        };
+        const ExprNode& expr = ir.nodes[index];
+        bool first = true;
+        out += "(";
+        children(index, width, is_signed, [&](uint32_t child, uint32_t w, bool s) {
+            if (!first)
+                out += symbols[(int)expr.op];
+            first = false;
+            write(child, w, s);
+        });
+        out += ")";
+    }
+
+    static std::string hexConstant(unsigned __int128 value, uint32_t width) {
+        std::string digits;
+        do {
+            digits.insert(digits.begin(), "0123456789abcdef"[(int)(value & 15)]);
+            value >>= 4;
+        } while (value != 0);
+        return std::to_string(width) + "'h" + digits;
+    }
+
+    const ConstraintIR& ir;
+    std::string& out;
+    std::vector<uint32_t> self_width;
+    std::vector<char> self_signed;
+    std::unordered_map<uint64_t, Use> uses;
+    std::vector<uint32_t> divides;
+    std::unordered_set<uint32_t> divide_seen;
+    int num_wires = 0;
+};
+
+// 生成整个Verilog模块
+std::string constraint_to_verilog(const ConstraintIR& ir) {
+    std::string verilog_code = "module test(\n";
+    generate_variable_declarations(ir, verilog_code);
+    verilog_code += ");\n\n";
+    VerilogEmitter(ir, verilog_code).generate_constraints();
+    verilog_code += "endmodule\n";
+    return verilog_code;
+}
+
+// 变量表: 每行 "名字 位宽 是否有符号 AIG输入起始下标 AIG输入结束下标", 输入下标从0开始.
+// Verilog端口按变量顺序声明, yosys按端口顺序编号AIG输入, 所以下标即IR中的位置
+std::string generate_variable_map(const ConstraintIR& ir) {
+    std::string map_text = "varmap " + std::to_string(ir.vars.size()) + "\n";
+    for (const auto& var : ir.vars) {
+        map_text += var.name + " " + std::to_string(var.width) + " " + (var.is_signed ? "1" : "0") + " "
+                  + std::to_string(var.first_bit) + " " + std::to_string(var.first_bit + var.width - 1) + "\n";
+    }
+    return map_text;
+}
@@ -25,25 +25,12 @@ fi
 mkdir -p "$RUN_DIR"
 
 BASE_DIR="/root/workspace/sv-sampler-lab/run_dir"
-JSON_DIR="${BASE_DIR}/json"
-CUDD_DIR="${BASE_DIR}/cudd"
-JSON_TO_VERILOG="${BASE_DIR}/json_to_verilog"
-JSON_TO_BITWIDTH="${BASE_DIR}/json_to_bitwidth"
-AIG_TO_BDD="${BASE_DIR}/aig_to_BDD"
-BASE_FILENAME=$(basename "$CONSTRAINT_JSON" .json)
-BITWIGTH_FILE="${RUN_DIR}/${BASE_FILENAME}.bitwidth.txt"
-VERILOG_FILE="${RUN_DIR}/${BASE_FILENAME}.v"
-AIG_FILE="${RUN_DIR}/${BASE_FILENAME}.aig"
+CONSTRAINT_SAMPLER="${BASE_DIR}/constraint_sampler"
 SAMPLES_FILE="${RUN_DIR}/result.json"
 
-"$JSON_TO_VERILOG" "$CONSTRAINT_JSON" "$VERILOG_FILE"
-"$JSON_TO_BITWIDTH" "$CONSTRAINT_JSON" "$BITWIGTH_FILE"
-
-yosys -q <<EOF
-read_verilog "$VERILOG_FILE"
-synth
-aigmap
-write_aiger -ascii "$AIG_FILE"
-EOF
-
-"$AIG_TO_BDD" "$AIG_FILE" "$NUM_SAMPLES" "$RANDOM_SEED" "$BITWIGTH_FILE" "$SAMPLES_FILE"
+# 单进程完成 JSON -> 化简 -> BDD -> 采样, 不写中间文件. 默认 (--backend bdd) 由约束表达式直接构建BDD,
+# 只有指定 --yosys 时才经 Verilog -> yosys 综合.
+# 编译结果按化简后约束的内容哈希缓存在 $SAMPLER_CACHE_DIR (默认 run_dir/cache),
+# 命中时跳过BDD构建. 设置 SAMPLER_CACHE_DIR= (空) 可关闭缓存
+CACHE_DIR="${SAMPLER_CACHE_DIR-${BASE_DIR}/cache}"
+"$CONSTRAINT_SAMPLER" "$CONSTRAINT_JSON" "$NUM_SAMPLES" "$RANDOM_SEED" "$SAMPLES_FILE" ${CACHE_DIR:+--cache-dir "$CACHE_DIR"}
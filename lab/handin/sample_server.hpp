@@ -0,0 +1,373 @@
+#pragma once
+
+#include <climits>
+#include <cerrno>
+#include <cctype>
+#include <sstream>
+#include <functional>
+#include <list>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "sampler.hpp"
+
+// 把写到ostream的内容直接send到socket, 对端关闭时返回失败而不是触发SIGPIPE
+class FdStreamBuf : public std::streambuf{
+public:
+    explicit FdStreamBuf(int fd) : fd(fd) {}
+
+protected:
+    std::streamsize xsputn(const char* data, std::streamsize n) override {
+        std::streamsize sent = 0;
+        while(sent < n){
+            ssize_t r = send(fd, data + sent, n - sent, MSG_NOSIGNAL);
+            if(r < 0 && errno == EINTR)
+                continue;
+            if(r <= 0)
+                return sent;
+            sent += r;
+        }
+        return sent;
+    }
+    int_type overflow(int_type c) override {
+        if(traits_type::eq_int_type(c, traits_type::eof()))
+            return traits_type::not_eof(c);
+        char ch = traits_type::to_char_type(c);
+        return xsputn(&ch, 1) == 1 ? c : traits_type::eof();
+    }
+
+private:
+    int fd;
+};
+
+bool sendAll(int fd, const std::string& text){
+    FdStreamBuf buf(fd);
+    return buf.sputn(text.data(), text.size()) == (std::streamsize)text.size();
+}
+
+// 读一行 (不含'\n'), 超过max_len或连接提前关闭时返回false
+bool readLine(int fd, std::string& line, size_t max_len = 4096){
+    line.clear();
+    char ch;
+    while(line.size() < max_len){
+        ssize_t r = read(fd, &ch, 1);
+        if(r < 0 && errno == EINTR)
+            continue;
+        if(r <= 0)
+            return false;
+        if(ch == '\n')
+            return true;
+        line += ch;
+    }
+    return false;
+}
+
+// 文件的 设备/inode/大小/修改时间, 追加到key. 文件没有变化时key不变, 不必读取文件内容
+bool appendFileIdentity(const std::string& filename, std::string& key){
+    struct stat st;
+    if(stat(filename.c_str(), &st) != 0)
+        return false;
+    key += std::to_string(st.st_dev) + ":" + std::to_string(st.st_ino) + ":" + std::to_string(st.st_size) + ":"
+         + std::to_string(st.st_mtim.tv_sec) + "." + std::to_string(st.st_mtim.tv_nsec) + ";";
+    return true;
+}
+
+// 样本之后的结束记录: 只有样本全部写出后服务端才发送, 客户端据此区分完整的输出与中途断开的连接
+struct StreamTrailer{
+    char magic[8];
+    uint64_t bytes;         // 之前写出的样本输出的字节数
+};
+static_assert(sizeof(StreamTrailer) == 16, "StreamTrailer is part of the server protocol");
+
+const char TRAILER_MAGIC[8] = {'\0', 'S', 'M', 'P', 'L', 'E', 'N', 'D'};
+
+// 编译好的约束: 互相独立的各部分的采样DAG, 以及变量在path中的布局
+struct CompiledConstraint{
+    std::vector<std::unique_ptr<SampleDag>> storage;
+    SampleDags dags;
+    std::vector<VarLayout> vars;
+};
+
+// 常驻采样服务: 编译好的约束常驻内存, 重复的请求跳过全部编译.
+// 每个连接发送一行请求
+//     <input_file> <num_samples> <seed> [--varmap <file>] [--compact] [--format json|ndjson|memh|bin]
+// 服务端先回一行 "OK" 或 "ERROR <原因>", 然后流式写回样本, 全部写出后再发送StreamTrailer并关闭连接.
+// 没有收到结束记录的输出是不完整的.
+// 输入文件由compile回调编译, 结果按输入文件 (和变量映射文件) 的路径常驻, 文件的标识没有变化时直接命中,
+// 文件改写后新的结果替换同一路径的旧结果. 常驻的结果最多max_cached个, 超出时淘汰最久未用的.
+// 连接由固定数量的工作线程处理, 等待处理的连接数有上限
+class SampleServer{
+public:
+    // 编译输入文件 (map_filename可以为空), 失败时返回空指针并给出原因. 编译串行进行, 回调不需要加锁
+    using Compiler = std::function<std::shared_ptr<const CompiledConstraint>(const std::string& input_filename,
+                                                                           const std::string& map_filename,
+                                                                           std::string& error)>;
+
+    SampleServer(Compiler compile, int num_workers, int num_threads, size_t max_pending, size_t max_cached)
+        : compile(compile), num_workers(num_workers), num_threads(num_threads), max_pending(max_pending),
+          max_cached(std::max<size_t>(1, max_cached)) {}
+
+    int run(const std::string& socket_path){
+        int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        if(listen_fd < 0 || socket_path.size() >= sizeof(addr.sun_path)){
+            std::cerr<<"Cannot create socket "<<socket_path<<"\n";
+            return 1;
+        }
+        strncpy(addr.sun_path, socket_path.c_str(), sizeof(addr.sun_path) - 1);
+        unlink(socket_path.c_str());
+        if(bind(listen_fd, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(listen_fd, 64) != 0){
+            std::cerr<<"Cannot listen on "<<socket_path<<"\n";
+            close(listen_fd);
+            return 1;
+        }
+        std::vector<std::thread> workers;
+        for(int t = 0; t < num_workers; t++)
+            workers.emplace_back([this]{ work(); });
+        while(true){
+            int fd = accept(listen_fd, nullptr, nullptr);
+            if(fd < 0){
+                if(errno == EINTR || errno == ECONNABORTED)
+                    continue;
+                std::cerr<<"Cannot accept on "<<socket_path<<"\n";
+                break;
+            }
+            std::unique_lock<std::mutex> lock(mutex);
+            not_full.wait(lock, [&]{ return pending.size() < max_pending; });
+            pending.push_back(fd);
+            not_empty.notify_one();
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            done = true;
+            not_empty.notify_all();
+        }
+        for(auto& worker : workers)
+            worker.join();
+        close(listen_fd);
+        unlink(socket_path.c_str());
+        return 1;
+    }
+
+private:
+    void work(){
+        while(true){
+            int fd;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                not_empty.wait(lock, [&]{ return done || !pending.empty(); });
+                if(pending.empty())
+                    return;
+                fd = pending.front();
+                pending.pop_front();
+                not_full.notify_one();
+            }
+            serve(fd);
+            close(fd);
+        }
+    }
+
+    // 路径对应的结果仍是identity时返回它, 并记为最近使用
+    std::shared_ptr<const CompiledConstraint> findCached(const std::string& path, const std::string& identity){
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        auto it = cache.find(path);
+        if(it == cache.end() || it->second.identity != identity)
+            return nullptr;
+        lru.splice(lru.begin(), lru, it->second.lru);
+        return it->second.compiled;
+    }
+
+    // 替换路径对应的旧结果, 并淘汰超出max_cached的最久未用的结果
+    void storeCached(const std::string& path, const std::string& identity, std::shared_ptr<const CompiledConstraint> compiled){
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        auto it = cache.find(path);
+        if(it != cache.end()){
+            lru.erase(it->second.lru);
+            cache.erase(it);
+        }
+        lru.push_front(path);
+        cache[path] = CacheEntry{identity, compiled, lru.begin()};
+        while(cache.size() > max_cached){
+            cache.erase(lru.back());
+            lru.pop_back();
+        }
+    }
+
+    // 取出 (必要时编译) 输入文件对应的约束
+    std::shared_ptr<const CompiledConstraint> compiled(const std::string& input_filename, const std::string& map_filename,
+                                                       std::string& error){
+        std::string identity;
+        if(!appendFileIdentity(input_filename, identity) || (!map_filename.empty() && !appendFileIdentity(map_filename, identity))){
+            error = "Cannot open " + (map_filename.empty() ? input_filename : input_filename + " or " + map_filename);
+            return nullptr;
+        }
+        // 请求中的文件名不含空白, 用空格拼接不会有歧义
+        std::string path = input_filename + " " + map_filename;
+        std::shared_ptr<const CompiledConstraint> result = findCached(path, identity);
+        if(result != nullptr)
+            return result;
+        // 编译串行进行, 同一文件不会被重复编译
+        std::lock_guard<std::mutex> compile_lock(compile_mutex);
+        result = findCached(path, identity);
+        if(result != nullptr)
+            return result;
+        result = compile(input_filename, map_filename, error);
+        if(result == nullptr)
+            return nullptr;
+        storeCached(path, identity, result);
+        return result;
+    }
+
+    void serve(int fd){
+        std::string line;
+        if(!readLine(fd, line))
+            return;
+        std::istringstream request(line);
+        std::string input_filename, map_filename, opt;
+        long long num_samples;
+        unsigned long long seed;
+        bool compact = false;
+        std::string format_name = "json";
+        if(!(request >> input_filename >> num_samples >> seed) || num_samples < 0 || num_samples > INT_MAX){
+            sendAll(fd, "ERROR Bad request\n");
+            return;
+        }
+        while(request >> opt){
+            if(opt == "--compact")
+                compact = true;
+            else if(opt == "--varmap" && request >> map_filename)
+                continue;
+            else if(opt == "--format" && request >> format_name){
+                if(!isFormatName(format_name)){
+                    sendAll(fd, "ERROR Unknown format " + format_name + "\n");
+                    return;
+                }
+            }
+            else {
+                sendAll(fd, "ERROR Unknown option " + opt + "\n");
+                return;
+            }
+        }
+        std::string error;
+        std::shared_ptr<const CompiledConstraint> constraint = compiled(input_filename, map_filename, error);
+        if(constraint != nullptr && num_samples > 0){
+            for(const SampleDag* dag : constraint->dags)
+                if(dag->root == 1)
+                    error = "Constraints are unsatisfiable";
+        }
+        if(!error.empty()){
+            sendAll(fd, "ERROR " + error + "\n");
+            return;
+        }
+        if(!sendAll(fd, "OK\n"))
+            return;
+        std::unique_ptr<SampleFormat> format = makeFormat(format_name, compact, constraint->vars);
+        FdStreamBuf buf(fd);
+        std::ostream out(&buf);
+        AsyncWriter writer(out);
+        writeSamples(constraint->dags, constraint->vars, *format, num_samples, seed, num_threads, writer);
+        if(!writer.finish())
+            return;
+        StreamTrailer trailer;
+        memcpy(trailer.magic, TRAILER_MAGIC, sizeof(TRAILER_MAGIC));
+        trailer.bytes = outputSize(*format, num_samples);
+        sendAll(fd, std::string(reinterpret_cast<const char*>(&trailer), sizeof(trailer)));
+    }
+
+    Compiler compile;
+    int num_workers;
+    int num_threads;
+    size_t max_pending;
+    size_t max_cached;
+    std::deque<int> pending;
+    std::mutex mutex;
+    std::condition_variable not_empty;
+    std::condition_variable not_full;
+    bool done = false;
+
+    struct CacheEntry{
+        std::string identity;
+        std::shared_ptr<const CompiledConstraint> compiled;
+        std::list<std::string>::iterator lru;
+    };
+    std::unordered_map<std::string, CacheEntry> cache;      // 路径 -> 结果
+    std::list<std::string> lru;                             // 路径, 最近使用的在前
+    std::mutex cache_mutex;
+    std::mutex compile_mutex;
+};
+
+// 把请求转发给常驻服务, 并把返回的样本写到output_filename.
+// 最后sizeof(StreamTrailer)个字节先留在tail中, 连接关闭后检查它是否是与已写出的字节数相符的结束记录
+int requestSamples(const std::string& socket_path, const std::string& request, const std::string& output_filename){
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, socket_path.c_str(), sizeof(addr.sun_path) - 1);
+    if(fd < 0 || connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0){
+        std::cerr<<"Cannot connect to "<<socket_path<<"\n";
+        if(fd >= 0)
+            close(fd);
+        return 1;
+    }
+    std::string status;
+    if(!sendAll(fd, request + "\n") || !readLine(fd, status) || status != "OK"){
+        std::cerr<<(status.empty() ? "Connection closed by " + socket_path : status.substr(status.find(' ') + 1))<<"\n";
+        close(fd);
+        return 1;
+    }
+    std::ofstream output_fout;
+    if(output_filename != "-"){
+        output_fout.open(output_filename, std::ios::binary);
+        if (!output_fout) {
+            std::cerr<<"Cannot open "<<output_filename<<"\n";
+            close(fd);
+            return 1;
+        }
+    }
+    std::ostream& out = output_filename == "-" ? std::cout : output_fout;
+    std::vector<char> buf(1 << 16);
+    std::string tail;
+    uint64_t written = 0;
+    ssize_t r;
+    while((r = read(fd, buf.data(), buf.size())) != 0){
+        if(r < 0 && errno == EINTR)
+            continue;
+        if(r < 0)
+            break;
+        tail.append(buf.data(), r);
+        if(tail.size() > sizeof(StreamTrailer)){
+            size_t n = tail.size() - sizeof(StreamTrailer);
+            out.write(tail.data(), n);
+            tail.erase(0, n);
+            written += n;
+        }
+    }
+    close(fd);
+    out.flush();
+    if (!out) {
+        std::cerr<<"Cannot write "<<output_filename<<"\n";
+        return 1;
+    }
+    StreamTrailer trailer;
+    if(r == 0 && tail.size() == sizeof(trailer))
+        memcpy(&trailer, tail.data(), sizeof(trailer));
+    if(r != 0 || tail.size() != sizeof(trailer) || memcmp(trailer.magic, TRAILER_MAGIC, sizeof(TRAILER_MAGIC)) != 0
+       || trailer.bytes != written){
+        std::cerr<<"Incomplete response from "<<socket_path<<"\n";
+        return 1;
+    }
+    return 0;
+}
+
+// 请求中的文件名由服务端解析, 需要转成绝对路径.
+// 请求是一行以空白分隔的字段, 文件名中不能含空白
+bool requestPath(const std::string& filename, std::string& path){
+    char* resolved = realpath(filename.c_str(), nullptr);
+    path = resolved == nullptr ? filename : resolved;
+    free(resolved);
+    if(std::any_of(path.begin(), path.end(), [](unsigned char c){ return std::isspace(c); })){
+        std::cerr << "Path " << path << " contains whitespace, which --connect cannot pass to the server\n";
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,1417 @@
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <unordered_set>
+#include <unordered_map>
+#include <algorithm>
+#include <random>
+#include <cassert>
+#include <queue>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+#include <utility>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <chrono>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <linux/perf_event.h>
+#include "cuddObj.hh"
+#include "cuddInt.h"
+
+// 每个BDD结点 (按所带的补边) 到常量的路径数: odd为取反次数为奇数的路径, 即到达逻辑0的路径.
+// 每次计数各用一份, 不同的DdManager可以并行计数
+struct PathCounts{
+    std::unordered_map<DdNode*, __float128> odd;
+    std::unordered_map<DdNode*, __float128> even;
+};
+
+// 按需提供随机比特: 每次从生成器取64位, 从高位开始逐位消耗
+struct BitSource{
+    std::mt19937_64 gen;
+    uint64_t word = 0;
+    int left = 0;
+
+    void seed(uint64_t s){
+        gen.seed(s);
+        left = 0;
+    }
+    int next(){
+        if(left == 0){
+            word = gen();
+            left = 64;
+        }
+        left--;
+        return (word >> left) & 1;
+    }
+};
+
+std::pair<__float128,__float128> countPaths(DdManager* mgr, DdNode* n, PathCounts& counts){
+    
+    auto it = counts.even.find(n);
+    if(it != counts.even.end()){
+        return std::make_pair(counts.odd[n], counts.even[n]);
+    }
+
+    if(Cudd_IsConstant(n)){
+        __float128 odd = 0, even = 0;
+        if(Cudd_IsComplement(n)) odd = 1;
+        else even = 1;
+        counts.odd[n] = odd;
+        counts.even[n] = even;
+        return std::make_pair(odd, even);
+    }
+
+    DdNode* real = Cudd_Regular(n);
+    bool is_complement = Cudd_IsComplement(n);
+    DdNode* t = Cudd_T(real);
+    DdNode* e = Cudd_E(real);
+
+    auto [odd_t, even_t] = countPaths(mgr, t, counts);
+    auto [odd_e, even_e] = countPaths(mgr, e, counts);
+    __float128 odd = odd_t + odd_e;
+    __float128 even = even_t + even_e;
+    if(is_complement)
+        std::swap(odd, even);
+    counts.odd[n] = odd;
+    counts.even[n] = even;
+    return std::make_pair(odd, even);
+}
+
+// 扁平化的采样DAG结点: 0号结点为常量1, 子边编码为 (下标<<1 | 补边标记)
+// 采样状态同样编码为 (下标<<1 | 奇偶性), 走子边后的状态为 child ^ odd
+struct SampleNode{
+    uint32_t var;
+    uint32_t child[2];      // [0]=else, [1]=then
+    uint32_t level;         // 变量在BDD中的层次, 非常量子结点的层次严格更大
+    uint64_t thr[2];        // 以奇偶性odd到达时走then分支的概率 * 2^64
+};
+static_assert(sizeof(SampleNode) == 32, "SampleNode is part of the DAG file format");
+
+// 跳表: 对根附近的热点状态, 预先枚举最多JUMP_K层的所有路径及其累积概率,
+// 一次随机抽取即可连续下降JUMP_K层, 减少根附近串行的访存依赖
+const int JUMP_K = 4;
+const int JUMP_ROUNDS = 2;
+const size_t JUMP_MAX_TABLES = 4096;
+
+struct JumpEntry{
+    uint64_t lo;            // 该路径在[0, 2^64)中所占区间的下端
+    uint32_t dest;          // 跳跃后的状态
+    uint8_t steps;          // 本次下降的层数
+    uint8_t bits;           // 第i层的取值为 (bits >> i) & 1
+    uint32_t vars[JUMP_K];
+};
+
+// 采样DAG: 计数完成后采样只需要拓扑和分支阈值, 不再需要DdManager.
+// 结点按BDD层序排列, 可以写成文件, 由任意多个采样进程mmap共享
+struct SampleDag{
+    uint32_t num_vars = 0;      // path数组的长度
+    uint32_t root = 0;          // 根状态
+    uint32_t num_nodes = 0;
+    const SampleNode* nodes = nullptr;
+    std::vector<SampleNode> storage;
+    std::vector<uint64_t> path_template;    // 每个样本path的初值, 给出不在BDD中的已知位; 空表示全0
+    std::vector<uint64_t> free_mask;        // 不在BDD支撑集中、也不由初值给定的位, 每个样本直接用随机字填充
+    std::vector<uint64_t> fixed_mask;       // 在所有解中取值都相同、由初值给定的位
+    void* mapped = nullptr;
+    size_t mapped_size = 0;
+
+    std::vector<JumpEntry> jump_entries;
+    std::vector<std::pair<uint32_t, uint32_t>> jump_tables;   // [begin, end) in jump_entries
+    std::vector<int> jump_table_of;                           // 状态 -> jump_tables下标, -1表示无表
+
+    SampleDag() = default;
+    // 映射区只能有一个所有者: 不可复制, 移动后源对象不再持有映射
+    SampleDag(const SampleDag&) = delete;
+    SampleDag& operator=(const SampleDag&) = delete;
+    SampleDag(SampleDag&& other) noexcept {
+        *this = std::move(other);
+    }
+    SampleDag& operator=(SampleDag&& other) noexcept {
+        if(this == &other)
+            return *this;
+        if(mapped != nullptr)
+            munmap(mapped, mapped_size);
+        num_vars = std::exchange(other.num_vars, 0);
+        root = std::exchange(other.root, 0);
+        num_nodes = std::exchange(other.num_nodes, 0);
+        nodes = std::exchange(other.nodes, nullptr);
+        storage = std::move(other.storage);
+        path_template = std::move(other.path_template);
+        free_mask = std::move(other.free_mask);
+        fixed_mask = std::move(other.fixed_mask);
+        mapped = std::exchange(other.mapped, nullptr);
+        mapped_size = std::exchange(other.mapped_size, 0);
+        jump_entries = std::move(other.jump_entries);
+        jump_tables = std::move(other.jump_tables);
+        jump_table_of = std::move(other.jump_table_of);
+        return *this;
+    }
+
+    ~SampleDag(){
+        if(mapped != nullptr)
+            munmap(mapped, mapped_size);
+    }
+
+    // 回到空的初始状态, 释放映射的文件
+    void clear(){
+        *this = SampleDag();
+    }
+};
+
+// DAG文件: 文件头后是key_bytes字节的键 (补齐到8字节), 之后是num_nodes个SampleNode, 再跟template_words个64位的path初值,
+// 以及同样长的free_mask和fixed_mask, 均为小端. 键记录文件由什么编译而来, 可以为空
+struct DagFileHeader{
+    char magic[4];
+    uint32_t version;
+    uint32_t num_vars;
+    uint32_t num_nodes;
+    uint32_t root;
+    uint32_t template_words;
+    uint32_t key_bytes;
+    uint32_t reserved;
+};
+static_assert(sizeof(DagFileHeader) == 32, "DagFileHeader is part of the DAG file format");
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "DAG files are little-endian");
+
+const char DAG_MAGIC[4] = {'S', 'D', 'A', 'G'};
+const uint32_t DAG_VERSION = 6;
+
+const long double TWO_POW_64 = 18446744073709551616.0L;
+
+// 0和UINT64_MAX表示确定分支, 只有真正的单侧分支才会取到这两个值
+uint64_t probToThreshold(__float128 cnt_left, __float128 cnt_right){
+    if(cnt_left + cnt_right <= 0)
+        return 1ULL << 63;
+    if(cnt_right <= 0)
+        return UINT64_MAX;
+    if(cnt_left <= 0)
+        return 0;
+    __float128 scaled = cnt_left / (cnt_left + cnt_right) * (__float128)TWO_POW_64;
+    if(scaled < 1)
+        return 1;
+    if(scaled >= (__float128)UINT64_MAX)
+        return UINT64_MAX - 1;
+    return static_cast<uint64_t>(scaled);
+}
+
+long double thresholdToProb(uint64_t thr){
+    return thr == UINT64_MAX ? 1.0L : thr / TWO_POW_64;
+}
+
+// 以概率 thr/2^64 返回1: 逐位比较均匀随机数u与thr的二进制展开, 第一个不同的位即决定 u < thr,
+// 期望消耗不超过2个比特; 确定分支不消耗比特
+inline int drawBranch(uint64_t thr, BitSource& bits){
+    if(thr == 0)
+        return 0;
+    if(thr == UINT64_MAX)
+        return 1;
+    for(int k = 63; ; k--){
+        int t = (thr >> k) & 1;
+        if(bits.next() != t)
+            return t;
+        if((thr & ((1ULL << k) - 1)) == 0)
+            return 0;
+    }
+}
+
+// 区间算术: 已消耗j个比特时u落在长为2^(64-j)的区间内, 区间只跨一个表项时即可停止
+inline const JumpEntry* drawEntry(const JumpEntry* begin, const JumpEntry* end, BitSource& bits){
+    const JumpEntry* low = begin;
+    const JumpEntry* high = end - 1;
+    uint64_t u = 0;
+    for(int j = 63; low != high; j--){
+        u |= (uint64_t)bits.next() << j;
+        uint64_t u_max = u | ((1ULL << j) - 1);
+        while(low != high && (low + 1)->lo <= u)
+            low++;
+        while(high != low && high->lo > u_max)
+            high--;
+    }
+    return low;
+}
+
+void collectNodes(DdNode* real, std::unordered_map<DdNode*, uint32_t>& index, std::vector<DdNode*>& order){
+    if(Cudd_IsConstant(real) || index.count(real))
+        return;
+    index[real] = 0;
+    collectNodes(Cudd_Regular(Cudd_T(real)), index, order);
+    collectNodes(Cudd_Regular(Cudd_E(real)), index, order);
+    order.push_back(real);
+}
+
+// 把已计数的BDD展开成按层序排列的结点数组
+void buildSampleDag(DdManager* mgr, DdNode* root, uint32_t num_vars, PathCounts& counts, SampleDag& dag){
+    std::unordered_map<DdNode*, uint32_t> index;
+    std::vector<DdNode*> order;
+    collectNodes(Cudd_Regular(root), index, order);
+    std::stable_sort(order.begin(), order.end(), [&](DdNode* a, DdNode* b){
+        return Cudd_ReadPerm(mgr, Cudd_NodeReadIndex(a)) < Cudd_ReadPerm(mgr, Cudd_NodeReadIndex(b));
+    });
+    index[Cudd_Regular(Cudd_ReadOne(mgr))] = 0;
+    for(size_t i = 0; i < order.size(); i++)
+        index[order[i]] = i + 1;
+
+    dag.storage.assign(order.size() + 1, SampleNode{0, {0, 0}, 0, {0, 0}});
+    for(size_t i = 0; i < order.size(); i++){
+        DdNode* t = Cudd_T(order[i]);
+        DdNode* e = Cudd_E(order[i]);
+        SampleNode& node = dag.storage[i + 1];
+        node.var = Cudd_NodeReadIndex(order[i]);
+        node.level = Cudd_ReadPerm(mgr, node.var);
+        node.child[1] = index[Cudd_Regular(t)] << 1 | Cudd_IsComplement(t);
+        node.child[0] = index[Cudd_Regular(e)] << 1 | Cudd_IsComplement(e);
+        auto [odd_t, even_t] = countPaths(mgr, t, counts);
+        auto [odd_e, even_e] = countPaths(mgr, e, counts);
+        for(int odd = 0; odd < 2; odd++){
+            __float128 cnt_left = odd ? odd_t : even_t;
+            __float128 cnt_right = odd ? odd_e : even_e;
+            node.thr[odd] = probToThreshold(cnt_left, cnt_right);
+        }
+    }
+    dag.num_vars = num_vars;
+    dag.root = index[Cudd_Regular(root)] << 1 | Cudd_IsComplement(root);
+    dag.num_nodes = dag.storage.size();
+    dag.nodes = dag.storage.data();
+}
+
+void topoOrder(const SampleDag& dag, uint32_t idx, std::vector<char>& visited, std::vector<uint32_t>& order){
+    if(idx == 0 || visited[idx])
+        return;
+    visited[idx] = 1;
+    topoOrder(dag, dag.nodes[idx].child[1] >> 1, visited, order);
+    topoOrder(dag, dag.nodes[idx].child[0] >> 1, visited, order);
+    order.push_back(idx);
+}
+
+// 按热路径重新编号: 按到达概率从高到低取尚未编号的结点, 沿概率较大的子边一路向下连续编号,
+// 使最可能的采样路径落在相邻的缓存行上. 分支概率与编号无关, 同一种子的采样结果不变
+void renumberHotPath(SampleDag& dag){
+    std::vector<char> visited(dag.num_nodes, 0);
+    std::vector<uint32_t> order;
+    topoOrder(dag, dag.root >> 1, visited, order);
+    std::reverse(order.begin(), order.end());
+
+    std::vector<long double> reach((size_t)dag.num_nodes * 2, 0);
+    std::vector<long double> mass(dag.num_nodes, 0);
+    std::vector<long double> edge_mass((size_t)dag.num_nodes * 2, 0);
+    reach[dag.root] = 1;
+    for(auto idx : order){
+        const SampleNode& node = dag.nodes[idx];
+        for(int odd = 0; odd < 2; odd++){
+            long double r = reach[idx << 1 | odd];
+            long double p = thresholdToProb(node.thr[odd]);
+            reach[node.child[1] ^ odd] += r * p;
+            reach[node.child[0] ^ odd] += r * (1 - p);
+            edge_mass[idx << 1 | 1] += r * p;
+            edge_mass[idx << 1] += r * (1 - p);
+        }
+        mass[idx] = reach[idx << 1] + reach[idx << 1 | 1];
+    }
+
+    std::vector<uint32_t> by_mass = order;
+    std::stable_sort(by_mass.begin(), by_mass.end(), [&](uint32_t a, uint32_t b){
+        return mass[a] > mass[b];
+    });
+    std::vector<uint32_t> new_index(dag.num_nodes, 0);
+    uint32_t next = 1;
+    for(auto start : by_mass){
+        uint32_t cur = start;
+        while(cur != 0 && new_index[cur] == 0){
+            new_index[cur] = next++;
+            const SampleNode& node = dag.nodes[cur];
+            uint32_t t = node.child[1] >> 1, e = node.child[0] >> 1;
+            bool t_free = t != 0 && new_index[t] == 0;
+            bool e_free = e != 0 && new_index[e] == 0;
+            if(t_free && (!e_free || edge_mass[cur << 1 | 1] >= edge_mass[cur << 1]))
+                cur = t;
+            else
+                cur = e_free ? e : 0;
+        }
+    }
+
+    std::vector<SampleNode> storage(next, dag.nodes[0]);
+    for(auto idx : order){
+        SampleNode node = dag.nodes[idx];
+        for(int b = 0; b < 2; b++)
+            node.child[b] = new_index[node.child[b] >> 1] << 1 | (node.child[b] & 1);
+        storage[new_index[idx]] = node;
+    }
+    dag.root = new_index[dag.root >> 1] << 1 | (dag.root & 1);
+    dag.storage.swap(storage);
+    dag.num_nodes = dag.storage.size();
+    dag.nodes = dag.storage.data();
+}
+
+bool saveSampleDag(const SampleDag& dag, const std::string& filename, const std::string& key = ""){
+    std::ofstream fout(filename, std::ios::binary);
+    if(!fout){
+        std::cerr<<"Cannot open "<<filename<<"\n";
+        return false;
+    }
+    DagFileHeader header{};
+    memcpy(header.magic, DAG_MAGIC, sizeof(DAG_MAGIC));
+    header.version = DAG_VERSION;
+    header.num_vars = dag.num_vars;
+    header.num_nodes = dag.num_nodes;
+    header.root = dag.root;
+    size_t words = std::max({dag.path_template.size(), dag.free_mask.size(), dag.fixed_mask.size()});
+    header.template_words = words;
+    header.key_bytes = key.size();
+    fout.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    std::string padded_key = key;
+    padded_key.resize((key.size() + 7) / 8 * 8, '\0');
+    fout.write(padded_key.data(), padded_key.size());
+    fout.write(reinterpret_cast<const char*>(dag.nodes), sizeof(SampleNode) * dag.num_nodes);
+    for(const auto* bits : {&dag.path_template, &dag.free_mask, &dag.fixed_mask}){
+        std::vector<uint64_t> padded = *bits;
+        padded.resize(words, 0);
+        fout.write(reinterpret_cast<const char*>(padded.data()), sizeof(uint64_t) * words);
+    }
+    return static_cast<bool>(fout);
+}
+
+bool isDagFile(const std::string& filename){
+    char magic[4] = {0};
+    std::ifstream fin(filename, std::ios::binary);
+    fin.read(magic, sizeof(magic));
+    return fin && memcmp(magic, DAG_MAGIC, sizeof(DAG_MAGIC)) == 0;
+}
+
+// 只读映射DAG文件, 结点数组直接指向映射区, 多个进程共享同一份物理页.
+// 给出key时, 文件中记录的键必须与之逐字节相同
+bool loadSampleDag(const std::string& filename, SampleDag& dag, const std::string* key = nullptr){
+    int fd = open(filename.c_str(), O_RDONLY);
+    if(fd < 0){
+        std::cerr<<"Cannot open "<<filename<<"\n";
+        return false;
+    }
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(DagFileHeader)){
+        std::cerr<<"Invalid DAG file "<<filename<<"\n";
+        close(fd);
+        return false;
+    }
+    void* mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(mapped == MAP_FAILED){
+        std::cerr<<"Cannot mmap "<<filename<<"\n";
+        return false;
+    }
+    dag.mapped = mapped;
+    dag.mapped_size = st.st_size;
+
+    const DagFileHeader* header = static_cast<const DagFileHeader*>(mapped);
+    size_t key_size = ((size_t)header->key_bytes + 7) / 8 * 8;
+    if(memcmp(header->magic, DAG_MAGIC, sizeof(DAG_MAGIC)) != 0 || header->version != DAG_VERSION ||
+       header->num_nodes == 0 ||
+       (size_t)st.st_size != sizeof(DagFileHeader) + key_size + sizeof(SampleNode) * (size_t)header->num_nodes
+                              + 3 * sizeof(uint64_t) * (size_t)header->template_words){
+        std::cerr<<"Invalid DAG file "<<filename<<"\n";
+        return false;
+    }
+    const char* file_key = reinterpret_cast<const char*>(header + 1);
+    if(key != nullptr && (key->size() != header->key_bytes || memcmp(key->data(), file_key, key->size()) != 0)){
+        std::cerr<<filename<<" was compiled from different input\n";
+        return false;
+    }
+    dag.num_vars = header->num_vars;
+    dag.num_nodes = header->num_nodes;
+    dag.root = header->root;
+    dag.nodes = reinterpret_cast<const SampleNode*>(file_key + key_size);
+    const uint64_t* path_template = reinterpret_cast<const uint64_t*>(dag.nodes + dag.num_nodes);
+    size_t words = header->template_words;
+    dag.path_template.assign(path_template, path_template + words);
+    dag.free_mask.assign(path_template + words, path_template + 2 * words);
+    dag.fixed_mask.assign(path_template + 2 * words, path_template + 3 * words);
+
+    // 子结点的层次必须严格更大 (或为常量), 损坏的文件中的环会让跳表构建和采样永不结束
+    bool valid = (dag.root >> 1) < dag.num_nodes;
+    for(uint32_t i = 1; i < dag.num_nodes && valid; i++){
+        const SampleNode& node = dag.nodes[i];
+        valid = node.var < dag.num_vars;
+        for(int b = 0; b < 2 && valid; b++){
+            uint32_t child = node.child[b] >> 1;
+            valid = child < dag.num_nodes && (child == 0 || dag.nodes[child].level > node.level);
+        }
+    }
+    if(!valid){
+        std::cerr<<"Invalid DAG file "<<filename<<"\n";
+        return false;
+    }
+    return true;
+}
+
+void enumerateJumps(const SampleDag& dag, uint32_t state, int depth, long double prob, JumpEntry& cur,
+                    std::vector<JumpEntry>& out, std::vector<long double>& probs){
+    if(depth == JUMP_K || (state >> 1) == 0){
+        cur.dest = state;
+        cur.steps = depth;
+        out.push_back(cur);
+        probs.push_back(prob);
+        return;
+    }
+    const SampleNode& node = dag.nodes[state >> 1];
+    int odd = state & 1;
+    cur.vars[depth] = node.var;
+    for(int b = 1; b >= 0; b--){
+        if(node.thr[odd] == (b ? 0 : UINT64_MAX))
+            continue;
+        long double p = thresholdToProb(node.thr[odd]);
+        cur.bits = (cur.bits & ~(1u << depth)) | (b << depth);
+        enumerateJumps(dag, node.child[b] ^ odd, depth + 1, prob * (b ? p : 1 - p), cur, out, probs);
+    }
+}
+
+void buildJumpTables(SampleDag& dag){
+    auto& jump_entries = dag.jump_entries;
+    auto& jump_tables = dag.jump_tables;
+    auto& jump_table_of = dag.jump_table_of;
+    jump_entries.clear();
+    jump_tables.clear();
+    jump_table_of.assign((size_t)dag.num_nodes * 2, -1);
+    std::vector<uint32_t> frontier{dag.root};
+    for(int round = 0; round < JUMP_ROUNDS && !frontier.empty(); round++){
+        std::vector<uint32_t> next;
+        for(auto state : frontier){
+            if((state >> 1) == 0 || jump_table_of[state] >= 0)
+                continue;
+            if(jump_tables.size() >= JUMP_MAX_TABLES)
+                return;
+            std::vector<JumpEntry> entries;
+            std::vector<long double> probs;
+            JumpEntry cur{};
+            enumerateJumps(dag, state, 0, 1.0L, cur, entries, probs);
+            long double total = 0, cum = 0;
+            for(auto p : probs)
+                total += p;
+            for(size_t i = 0; i < entries.size(); i++){
+                long double lo = cum / total * TWO_POW_64;
+                entries[i].lo = lo >= (long double)UINT64_MAX ? UINT64_MAX : static_cast<uint64_t>(lo);
+                cum += probs[i];
+                next.push_back(entries[i].dest);
+            }
+            jump_table_of[state] = jump_tables.size();
+            jump_tables.emplace_back(jump_entries.size(), jump_entries.size() + entries.size());
+            jump_entries.insert(jump_entries.end(), entries.begin(), entries.end());
+        }
+        frontier.swap(next);
+    }
+}
+
+// 互相独立的几部分约束各自的采样DAG. 一个样本依次在每一部分中走一条路径,
+// 各部分设置path中互不相交的位, 拼起来就是整个样本
+using SampleDags = std::vector<const SampleDag*>;
+
+// 一条进行中的采样路径
+struct Walk{
+    int sample;             // 样本编号, -1表示空闲
+    size_t part;            // 当前所在的部分
+    int round;              // 已使用的跳表次数
+    uint32_t state;
+    BitSource bits;
+};
+
+// path按变量索引逐位打包, 每个样本开始前恢复为初值
+inline void setPathBit(std::vector<uint64_t>& path, uint32_t var, uint64_t b){
+    path[var >> 6] |= b << (var & 63);
+}
+
+// 推进一步(一次跳表或一个结点), 并预取下一步要访问的数据; 路径结束时返回false
+inline bool stepWalk(const SampleDag& dag, Walk& w, std::vector<uint64_t>& path){
+    int table = w.round < JUMP_ROUNDS ? dag.jump_table_of[w.state] : -1;
+    if(table >= 0){
+        auto [begin, end] = dag.jump_tables[table];
+        const JumpEntry* entry = drawEntry(&dag.jump_entries[begin], &dag.jump_entries[end], w.bits);
+        for(int i = 0; i < entry->steps; i++)
+            setPathBit(path, entry->vars[i], (entry->bits >> i) & 1);
+        w.state = entry->dest;
+        w.round++;
+    } else {
+        const SampleNode& node = dag.nodes[w.state >> 1];
+        int odd = w.state & 1;
+        int b = drawBranch(node.thr[odd], w.bits);
+        setPathBit(path, node.var, b);
+        w.state = node.child[b] ^ odd;
+        w.round = JUMP_ROUNDS;
+    }
+    if((w.state >> 1) == 0){
+        assert(w.state == 0);
+        return false;
+    }
+    if(w.round < JUMP_ROUNDS)
+        __builtin_prefetch(&dag.jump_table_of[w.state]);
+    __builtin_prefetch(&dag.nodes[w.state >> 1]);
+    return true;
+}
+
+// 同时推进WALK_LANES条相互独立的路径, 轮流各走一步, 用其他路径的计算掩盖当前路径的访存延迟.
+// 采样编号为[first, first+count), 第i个样本总是用seed+i初始化随机源, 先取随机字填充自由位, 再依次走完各部分,
+// 结果与路径的调度顺序无关. num_bits为path至少需要的位数
+const int WALK_LANES = 8;
+
+template <typename Emit>
+void sampleInterleaved(const SampleDags& dags, uint32_t num_bits, int first, int count, unsigned seed, Emit emit){
+    std::vector<uint64_t> initial((num_bits + 63) / 64, 0);
+    for(const SampleDag* dag : dags){
+        initial.resize(std::max(initial.size(), std::max<size_t>((dag->num_vars + 63) / 64, dag->path_template.size())), 0);
+        for(size_t i = 0; i < dag->path_template.size(); i++)
+            initial[i] |= dag->path_template[i];
+    }
+    // 自由位须在所有部分的支撑集以外
+    std::vector<uint64_t> free_mask(initial.size(), dags.empty() ? 0 : UINT64_MAX);
+    for(const SampleDag* dag : dags)
+        for(size_t i = 0; i < free_mask.size(); i++)
+            free_mask[i] &= i < dag->free_mask.size() ? dag->free_mask[i] : 0;
+    std::vector<uint32_t> free_words;
+    for(size_t i = 0; i < free_mask.size(); i++)
+        if(free_mask[i] != 0)
+            free_words.push_back(i);
+
+    std::vector<Walk> lanes(WALK_LANES);
+    std::vector<std::vector<uint64_t>> paths(WALK_LANES, initial);
+    int next_sample = first;
+    int active = 0;
+    auto start = [&](int l){
+        Walk& w = lanes[l];
+        if(next_sample >= first + count){
+            w.sample = -1;
+            return false;
+        }
+        w.sample = next_sample++;
+        w.part = 0;
+        w.round = 0;
+        w.state = dags[0]->root;
+        w.bits.seed(seed + w.sample);
+        for(uint32_t i : free_words)
+            paths[l][i] = initial[i] | (w.bits.gen() & free_mask[i]);
+        return true;
+    };
+    for(int l = 0; l < WALK_LANES; l++)
+        active += start(l);
+
+    while(active > 0){
+        for(int l = 0; l < WALK_LANES; l++){
+            Walk& w = lanes[l];
+            if(w.sample < 0 || ((w.state >> 1) != 0 && stepWalk(*dags[w.part], w, paths[l])))
+                continue;
+            assert(w.state == 0);
+            if(++w.part < dags.size()){
+                w.round = 0;
+                w.state = dags[w.part]->root;
+                continue;
+            }
+            emit(w.sample, paths[l]);
+            std::copy(initial.begin(), initial.end(), paths[l].begin());
+            if(!start(l))
+                active--;
+        }
+    }
+}
+
+// 统计当前布局下每个样本的缓存未命中: 硬件计数器(perf_event, 不可用时为-1),
+// 以及"跨缓存行的结点访问次数"这一与机器无关的模型指标
+void measureLayout(SampleDag& dag, int num_samples, unsigned seed, const char* name){
+    buildJumpTables(dag);
+
+    double misses = -1;
+    perf_event_attr attr{};
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    int fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    auto begin = std::chrono::steady_clock::now();
+    if(fd >= 0){
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+    sampleInterleaved({&dag}, dag.num_vars, 0, num_samples, seed, [](int, const std::vector<uint64_t>&){});
+    if(fd >= 0){
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        long long count = 0;
+        if(read(fd, &count, sizeof(count)) == sizeof(count))
+            misses = (double)count / num_samples;
+        close(fd);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    long long line_changes = 0;
+    for(int i = 0; i < num_samples; i++){
+        BitSource bits;
+        bits.seed(seed + i);
+        uint32_t state = dag.root;
+        uintptr_t line = 0;
+        while(state >> 1){
+            const SampleNode& node = dag.nodes[state >> 1];
+            uintptr_t cur = reinterpret_cast<uintptr_t>(&node) / 64;
+            line_changes += cur != line;
+            line = cur;
+            int odd = state & 1;
+            state = node.child[drawBranch(node.thr[odd], bits)] ^ odd;
+        }
+    }
+    std::cerr << name << " layout: " << misses << " cache misses/sample (perf), "
+              << (double)line_changes / num_samples << " cache lines/sample (model), "
+              << seconds * 1e9 / num_samples << " ns/sample\n";
+}
+
+// 后台写线程: 采样线程把格式化好的块放入有界队列, 写线程按顺序写出, 采样与磁盘IO重叠
+class AsyncWriter{
+public:
+    explicit AsyncWriter(std::ostream& out, size_t max_pending = 4)
+        : out(out), max_pending(max_pending), worker([this]{ run(); }) {}
+
+    ~AsyncWriter(){
+        finish();
+    }
+
+    void push(std::string chunk){
+        std::unique_lock<std::mutex> lock(mutex);
+        not_full.wait(lock, [&]{ return pending.size() < max_pending; });
+        pending.push_back(std::move(chunk));
+        not_empty.notify_one();
+    }
+
+    // 等待所有块写完, 返回输出流是否正常
+    bool finish(){
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            done = true;
+            not_empty.notify_one();
+        }
+        if(worker.joinable())
+            worker.join();
+        out.flush();
+        return static_cast<bool>(out);
+    }
+
+    // 输出流出错 (如对端关闭连接) 后不再写出, 采样方应尽早停止
+    bool failed() const {
+        return write_failed;
+    }
+
+private:
+    void run(){
+        while(true){
+            std::string chunk;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                not_empty.wait(lock, [&]{ return done || !pending.empty(); });
+                if(pending.empty())
+                    return;
+                chunk = std::move(pending.front());
+                pending.pop_front();
+                not_full.notify_one();
+            }
+            if(write_failed)
+                continue;
+            out.write(chunk.data(), chunk.size());
+            if(!out)
+                write_failed = true;
+        }
+    }
+
+    std::ostream& out;
+    size_t max_pending;
+    std::deque<std::string> pending;
+    std::mutex mutex;
+    std::condition_variable not_empty;
+    std::condition_variable not_full;
+    bool done = false;
+    std::atomic<bool> write_failed{false};
+    std::thread worker;
+};
+
+// 每次采样并格式化SAMPLE_CHUNK个样本, 内存占用与样本总数无关
+const int SAMPLE_CHUNK = 4096;
+
+// 变量在path中占据的位区间 [first_bit, first_bit + width)
+struct VarLayout{
+    uint32_t first_bit;
+    uint32_t width;
+    std::string name;       // 只用于报告, 可以为空
+};
+
+std::vector<VarLayout> layoutVariables(const std::vector<int>& bitwidths){
+    std::vector<VarLayout> vars;
+    uint32_t first_bit = 1;
+    for(int width : bitwidths){
+        vars.push_back(VarLayout{first_bit, (uint32_t)width, ""});
+        first_bit += width;
+    }
+    return vars;
+}
+
+// 取出path中从first开始的width位, 按64位字存入value (低位在前)
+void extractBits(const uint64_t* path, uint32_t first, uint32_t width, uint64_t* value){
+    uint32_t num_words = (width + 63) / 64;
+    for(uint32_t w = 0; w < num_words; w++){
+        uint32_t bit = first + w * 64;
+        uint64_t word = path[bit >> 6] >> (bit & 63);
+        if((bit & 63) != 0 && w * 64 + 64 - (bit & 63) < width)
+            word |= path[(bit >> 6) + 1] << (64 - (bit & 63));
+        uint32_t valid = std::min<uint32_t>(64, width - w * 64);
+        value[w] = valid == 64 ? word : word & ((1ULL << valid) - 1);
+    }
+}
+
+// 查表把一个字节转成两个十六进制字符
+struct HexTable{
+    char pairs[256][2];
+    HexTable(){
+        const char* digits = "0123456789abcdef";
+        for(int i = 0; i < 256; i++){
+            pairs[i][0] = digits[i >> 4];
+            pairs[i][1] = digits[i & 15];
+        }
+    }
+};
+static const HexTable hex_table;
+
+// 写出ceil(width/4)个十六进制字符, 高位在前, 保留前导0
+inline char* encodeHex(const uint64_t* value, uint32_t width, char* out){
+    uint32_t digits = (width + 3) / 4;
+    if(digits & 1){
+        uint32_t d = digits - 1;
+        *out++ = hex_table.pairs[(value[d >> 4] >> ((d & 15) * 4)) & 15][1];
+        digits--;
+    }
+    for(uint32_t d = digits; d > 0; d -= 2){
+        uint32_t byte = (d - 2) / 2;
+        unsigned pair = (value[byte >> 3] >> ((byte & 7) * 8)) & 255;
+        *out++ = hex_table.pairs[pair][0];
+        *out++ = hex_table.pairs[pair][1];
+    }
+    return out;
+}
+
+// 把width位的value按位放到dst的第offset位起 (dst需预先清零)
+void depositBits(const uint64_t* value, uint32_t width, uint32_t offset, uint64_t* dst){
+    for(uint32_t w = 0; w * 64 < width; w++){
+        uint32_t bit = offset + w * 64;
+        dst[bit >> 6] |= value[w] << (bit & 63);
+        if((bit & 63) != 0 && w * 64 + 64 - (bit & 63) < width)
+            dst[(bit >> 6) + 1] |= value[w] >> (64 - (bit & 63));
+    }
+}
+
+// 样本输出格式: 变量位宽固定, 每条记录的长度也固定, 因此可以并行格式化,
+// 并直接写到输出中的对应位置
+class SampleFormat{
+public:
+    virtual ~SampleFormat() = default;
+    virtual std::string header(int num_samples) const = 0;
+    virtual std::string footer(int num_samples) const = 0;
+    virtual size_t recordSize() const = 0;
+    // 写到文件时是否预先设定文件长度并mmap写入, 而不是流式写出
+    virtual bool writeMapped() const {
+        return false;
+    }
+    // 整个输出的第一条记录开头需要去掉的字节数
+    virtual size_t firstRecordSkip() const {
+        return 0;
+    }
+    // 在out处写出恰好recordSize()个字节
+    virtual void writeRecord(const uint64_t* path, char* out, std::vector<uint64_t>& scratch) const = 0;
+};
+
+// assignment_list的专用序列化器: 预先生成一条带好全部分隔符的记录模板, 写样本时只需拷贝模板并填入十六进制数字.
+// JSON模式下每条记录以样本间的分隔符开头, 整个列表的第一条记录去掉开头的','.
+// PRETTY与 json::dump(4) 的输出逐字节相同, COMPACT与 json::dump() 相同, NDJSON每行一个样本数组
+class JsonFormat : public SampleFormat{
+public:
+    enum Style { PRETTY, COMPACT, NDJSON };
+
+    JsonFormat(const std::vector<VarLayout>& vars, Style style) : vars(vars), style(style) {
+        bool pretty = style == PRETTY;
+        std::string item_begin = pretty ? "            {\n                \"value\": \"" : "{\"value\":\"";
+        std::string item_end = pretty ? "\"\n            }" : "\"}";
+        record = style == NDJSON ? "[" : pretty ? ",\n        [" : ",[";
+        if(!vars.empty() && pretty)
+            record += "\n";
+        for(size_t j = 0; j < vars.size(); j++){
+            if(j > 0)
+                record += pretty ? ",\n" : ",";
+            record += item_begin;
+            hex_offset.push_back(record.size());
+            record.append((vars[j].width + 3) / 4, '0');
+            record += item_end;
+        }
+        if(!vars.empty() && pretty)
+            record += "\n        ";
+        record += style == NDJSON ? "]\n" : "]";
+        for(auto& var : vars)
+            max_words = std::max<size_t>(max_words, (var.width + 63) / 64);
+    }
+
+    std::string header(int) const override {
+        if(style == NDJSON)
+            return "";
+        return style == COMPACT ? "{\"assignment_list\":[" : "{\n    \"assignment_list\": [";
+    }
+    std::string footer(int num_samples) const override {
+        if(style == NDJSON)
+            return "";
+        if(style == COMPACT)
+            return "]}";
+        return num_samples > 0 ? "\n    ]\n}" : "]\n}";
+    }
+    size_t recordSize() const override {
+        return record.size();
+    }
+    size_t firstRecordSkip() const override {
+        return style == NDJSON ? 0 : 1;
+    }
+    void writeRecord(const uint64_t* path, char* out, std::vector<uint64_t>& scratch) const override {
+        memcpy(out, record.data(), record.size());
+        scratch.resize(max_words);
+        for(size_t j = 0; j < vars.size(); j++){
+            extractBits(path, vars[j].first_bit, vars[j].width, scratch.data());
+            encodeHex(scratch.data(), vars[j].width, out + hex_offset[j]);
+        }
+    }
+
+private:
+    std::vector<VarLayout> vars;
+    Style style;
+    std::string record;
+    std::vector<size_t> hex_offset;
+    size_t max_words = 0;
+};
+
+// $readmemh格式: 每行一个样本, 按 {var_0, var_1, ...} 拼接成一个十六进制数 (var_0在最高位)
+class MemhFormat : public SampleFormat{
+public:
+    explicit MemhFormat(const std::vector<VarLayout>& vars) : vars(vars) {
+        for(auto& var : vars)
+            total_width += var.width;
+    }
+
+    std::string header(int) const override {
+        std::string text = "// {";
+        for(size_t j = 0; j < vars.size(); j++)
+            text += (j > 0 ? ", var_" : "var_") + std::to_string(j) + "[" + std::to_string(vars[j].width) + "]";
+        return text + "}\n";
+    }
+    std::string footer(int) const override {
+        return "";
+    }
+    size_t recordSize() const override {
+        return (total_width + 3) / 4 + 1;
+    }
+    void writeRecord(const uint64_t* path, char* out, std::vector<uint64_t>& scratch) const override {
+        size_t words = (total_width + 63) / 64;
+        scratch.assign(words * 2 + 1, 0);
+        uint64_t* value = scratch.data() + words + 1;
+        uint32_t offset = total_width;
+        for(auto& var : vars){
+            offset -= var.width;
+            std::fill(value, value + words, 0);
+            extractBits(path, var.first_bit, var.width, value);
+            depositBits(value, var.width, offset, scratch.data());
+        }
+        out = encodeHex(scratch.data(), total_width, out);
+        *out = '\n';
+    }
+
+private:
+    std::vector<VarLayout> vars;
+    uint32_t total_width = 0;
+};
+
+// 二进制格式: 文件头 "SMPL", 版本, 变量数, 每条记录的字节数, 样本数, 各变量位宽 (按8字节补齐),
+// 之后是样本记录, 每个变量按小端占ceil(width/8)个字节
+struct SampleFileHeader{
+    char magic[4];
+    uint32_t version;
+    uint32_t num_vars;
+    uint32_t record_bytes;
+    uint64_t num_samples;
+};
+static_assert(sizeof(SampleFileHeader) == 24, "SampleFileHeader is part of the sample file format");
+
+class BinaryFormat : public SampleFormat{
+public:
+    explicit BinaryFormat(const std::vector<VarLayout>& vars) : vars(vars) {
+        for(auto& var : vars)
+            record_bytes += (var.width + 7) / 8;
+    }
+
+    std::string header(int num_samples) const override {
+        SampleFileHeader header{{'S', 'M', 'P', 'L'}, 1, (uint32_t)vars.size(), (uint32_t)record_bytes, (uint64_t)num_samples};
+        std::string text(reinterpret_cast<const char*>(&header), sizeof(header));
+        for(auto& var : vars)
+            text.append(reinterpret_cast<const char*>(&var.width), sizeof(var.width));
+        text.resize((text.size() + 7) / 8 * 8, '\0');
+        return text;
+    }
+    std::string footer(int) const override {
+        return "";
+    }
+    size_t recordSize() const override {
+        return record_bytes;
+    }
+    bool writeMapped() const override {
+        return true;
+    }
+    void writeRecord(const uint64_t* path, char* out, std::vector<uint64_t>& scratch) const override {
+        for(auto& var : vars){
+            scratch.resize((var.width + 63) / 64);
+            extractBits(path, var.first_bit, var.width, scratch.data());
+            size_t bytes = (var.width + 7) / 8;
+            memcpy(out, scratch.data(), bytes);
+            out += bytes;
+        }
+    }
+
+private:
+    std::vector<VarLayout> vars;
+    size_t record_bytes = 0;
+};
+
+// 采样[first, first+count)号样本, 记录依次写到out起始的位置
+void formatChunk(const SampleDags& dags, const SampleFormat& format, uint32_t num_bits,
+                 int first, int count, unsigned seed, char* out){
+    size_t record_size = format.recordSize();
+    std::vector<uint64_t> scratch;
+    sampleInterleaved(dags, num_bits, first, count, seed, [&](int i, const std::vector<uint64_t>& path){
+        format.writeRecord(path.data(), out + record_size * (i - first), scratch);
+    });
+}
+
+uint32_t pathBits(const std::vector<VarLayout>& vars){
+    return vars.empty() ? 1 : vars.back().first_bit + vars.back().width;
+}
+
+// 每批由num_threads个线程各采样并格式化一块, 按编号顺序交给写线程, 内存占用与样本总数无关.
+// 写出失败后不再采样后续的批
+void writeSamples(const SampleDags& dags, const std::vector<VarLayout>& vars, const SampleFormat& format,
+                  int num_samples, unsigned seed, int num_threads, AsyncWriter& writer){
+    uint32_t num_bits = pathBits(vars);
+    writer.push(format.header(num_samples));
+    std::vector<std::string> chunks(num_threads);
+    for(int batch = 0; batch < num_samples && !writer.failed(); batch += num_threads * SAMPLE_CHUNK){
+        std::vector<std::thread> workers;
+        int used = 0;
+        for(int t = 0; t < num_threads && batch + t * SAMPLE_CHUNK < num_samples; t++, used++){
+            int first = batch + t * SAMPLE_CHUNK;
+            int count = std::min(SAMPLE_CHUNK, num_samples - first);
+            chunks[t].resize(format.recordSize() * count);
+            workers.emplace_back(formatChunk, std::cref(dags), std::cref(format), num_bits,
+                                 first, count, seed, &chunks[t][0]);
+        }
+        for(auto& worker : workers)
+            worker.join();
+        if(batch == 0 && used > 0)
+            chunks[0].erase(0, format.firstRecordSkip());
+        for(int t = 0; t < used; t++)
+            writer.push(std::move(chunks[t]));
+    }
+    writer.push(format.footer(num_samples));
+}
+
+// num_samples个样本的完整输出的字节数
+size_t outputSize(const SampleFormat& format, int num_samples){
+    size_t skip = num_samples > 0 ? format.firstRecordSkip() : 0;
+    return format.header(num_samples).size() + format.recordSize() * num_samples - skip + format.footer(num_samples).size();
+}
+
+// 输出大小事先已知: 预先设定文件长度并mmap, 各线程把样本块直接写进映射区
+bool writeSamplesMapped(const SampleDags& dags, const std::vector<VarLayout>& vars, const SampleFormat& format,
+                        int num_samples, unsigned seed, int num_threads, const std::string& filename){
+    std::string header = format.header(num_samples);
+    std::string footer = format.footer(num_samples);
+    size_t skip = num_samples > 0 ? format.firstRecordSkip() : 0;
+    size_t total = outputSize(format, num_samples);
+    int fd = open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0){
+        std::cerr<<"Cannot open "<<filename<<"\n";
+        return false;
+    }
+    if(total == 0){
+        close(fd);
+        return true;
+    }
+    if(ftruncate(fd, total) != 0){
+        std::cerr<<"Cannot write "<<filename<<"\n";
+        close(fd);
+        return false;
+    }
+    void* mapped = mmap(nullptr, total, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(mapped == MAP_FAILED){
+        std::cerr<<"Cannot mmap "<<filename<<"\n";
+        return false;
+    }
+    char* base = static_cast<char*>(mapped);
+    memcpy(base, header.data(), header.size());
+    char* records = base + header.size() - skip;
+    std::string first_record;
+
+    uint32_t num_bits = pathBits(vars);
+    int num_chunks = (num_samples + SAMPLE_CHUNK - 1) / SAMPLE_CHUNK;
+    std::atomic<int> next_chunk(0);
+    auto worker = [&]{
+        for(int c = next_chunk++; c < num_chunks; c = next_chunk++){
+            int first = c * SAMPLE_CHUNK;
+            int count = std::min(SAMPLE_CHUNK, num_samples - first);
+            if(first == 0 && skip > 0){
+                // 第一条记录的开头不属于输出, 先写到临时缓冲区
+                first_record.resize(format.recordSize());
+                formatChunk(dags, format, num_bits, 0, 1, seed, &first_record[0]);
+                memcpy(records + skip, first_record.data() + skip, first_record.size() - skip);
+                first++;
+                count--;
+            }
+            formatChunk(dags, format, num_bits, first, count, seed, records + format.recordSize() * first);
+        }
+    };
+    std::vector<std::thread> workers;
+    for(int t = 0; t < num_threads; t++)
+        workers.emplace_back(worker);
+    for(auto& w : workers)
+        w.join();
+    memcpy(base + total - footer.size(), footer.data(), footer.size());
+    bool ok = msync(mapped, total, MS_SYNC) == 0;
+    munmap(mapped, total);
+    if(!ok)
+        std::cerr<<"Cannot write "<<filename<<"\n";
+    return ok;
+}
+
+struct AND{
+    int lhs;
+    int rhs0;
+    int rhs1;
+    AND(int lhs, int rhs0, int rhs1) : lhs(lhs), rhs0(rhs0), rhs1(rhs1) {}
+};
+
+void topologicalSort(int node, const std::vector<std::vector<int>>& graph, std::vector<int>& visited, std::vector<int>& order) {
+    visited[node] = 1;
+    for(int to : graph[node]) 
+        if(!visited[to]) 
+            topologicalSort(to, graph, visited, order);
+    order.push_back(node);
+}
+
+
+// 变量1..num_vars-1中不在BDD支撑集里的位与约束无关, 记为自由位
+void markFreeBits(DdManager* mgr, DdNode* root, uint32_t num_vars, SampleDag& dag){
+    dag.free_mask.assign((num_vars + 63) / 64, 0);
+    for(uint32_t v = 1; v < num_vars; v++)
+        dag.free_mask[v / 64] |= 1ull << (v % 64);
+    DdNode* support = Cudd_Support(mgr, root);
+    Cudd_Ref(support);
+    for(DdNode* n = support; !Cudd_IsConstant(n); n = Cudd_T(n)){
+        uint32_t v = Cudd_NodeReadIndex(n);
+        if(v < num_vars)
+            dag.free_mask[v / 64] &= ~(1ull << (v % 64));
+    }
+    Cudd_RecursiveDeref(mgr, support);
+}
+
+// 把path中mask内的位固定为values中的值: 这些位不在BDD中, 由初值给出, 也不是自由位
+void fixPathBits(SampleDag& dag, const std::vector<uint64_t>& mask, const std::vector<uint64_t>& values){
+    size_t words = std::max({mask.size(), dag.path_template.size(), dag.fixed_mask.size()});
+    dag.path_template.resize(words, 0);
+    dag.fixed_mask.resize(words, 0);
+    for(size_t i = 0; i < mask.size(); i++){
+        dag.path_template[i] |= values[i] & mask[i];
+        dag.fixed_mask[i] |= mask[i];
+        if(i < dag.free_mask.size())
+            dag.free_mask[i] &= ~mask[i];
+    }
+}
+
+// 对BDD计数并展开成采样DAG.
+// 先取出必要位 (所有解中取值都相同的位, Cudd_FindEssential): 它们固定在path初值中, BDD按它们取余因子,
+// 每条到1的路径原本都经过这些变量, 去掉后路径数不变, 采样路径变短
+void countSampleDag(DdManager* mgr, DdNode* root, uint32_t num_vars, SampleDag& dag){
+    std::vector<uint64_t> mask((num_vars + 63) / 64, 0), values(mask.size(), 0);
+    DdNode* essential = Cudd_FindEssential(mgr, root);
+    Cudd_Ref(essential);
+    DdNode* restricted = Cudd_Cofactor(mgr, root, essential);
+    Cudd_Ref(restricted);
+    DdNode* zero = Cudd_ReadLogicZero(mgr);
+    for(DdNode* n = essential; !Cudd_IsConstant(n);){
+        DdNode* t = Cudd_T(Cudd_Regular(n));
+        DdNode* e = Cudd_E(Cudd_Regular(n));
+        if(Cudd_IsComplement(n)){
+            t = Cudd_Not(t);
+            e = Cudd_Not(e);
+        }
+        uint32_t v = Cudd_NodeReadIndex(n);
+        bool positive = e == zero;
+        if(v < num_vars){
+            mask[v / 64] |= 1ull << (v % 64);
+            values[v / 64] |= (uint64_t)positive << (v % 64);
+        }
+        n = positive ? t : e;
+    }
+    Cudd_RecursiveDeref(mgr, essential);
+
+    PathCounts counts;
+    countPaths(mgr, restricted, counts);
+    buildSampleDag(mgr, restricted, num_vars, counts, dag);
+    markFreeBits(mgr, restricted, num_vars, dag);
+    fixPathBits(dag, mask, values);
+    Cudd_RecursiveDeref(mgr, restricted);
+}
+
+// AIGER格式的与非图: 变量0为常量, 1..num_inputs为输入, 之后为与门
+struct Aig{
+    int max_var = 0;
+    int num_inputs = 0;
+    int output = 0;
+    std::vector<AND> gates;
+};
+
+// 读入ASCII AIGER (aag), 只支持单输出、无锁存器的组合电路
+bool parseAig(std::istream& aig_fin, Aig& aig){
+    std::string header;
+    aig_fin >> header;
+    int M, I, L, O, A;
+    aig_fin >> M >> I >> L >> O >> A;
+    if (!aig_fin || header != "aag" || L != 0 || O != 1) {
+        std::cerr<<"Cannot parse AIG\n";
+        return false;
+    }
+    aig.max_var = M;
+    aig.num_inputs = I;
+    for(int i = 0; i < I; ++i) {
+        int input;
+        aig_fin >> input;
+    }
+    aig_fin >> aig.output;
+    aig.gates.clear();
+    for(int i = 0;i < A;i++){
+        int lhs, rhs0, rhs1;
+        aig_fin >> lhs >> rhs0 >> rhs1;
+        aig.gates.emplace_back(lhs, rhs0, rhs1);
+    }
+    if (!aig_fin) {
+        std::cerr<<"Cannot parse AIG\n";
+        return false;
+    }
+    return true;
+}
+
+// 构建AIG输出的BDD并计数, 展开成采样DAG后释放DdManager
+bool buildDagFromAig(const Aig& aig, SampleDag& dag){
+    int M = aig.max_var;
+    int I = aig.num_inputs;
+    int output_idx = aig.output;
+
+    DdManager* mgr = Cudd_Init(0, 0, CUDD_UNIQUE_SLOTS * 2, CUDD_CACHE_SLOTS * 2, 0);
+
+    std::vector<DdNode*> bdd_vars(M+1,nullptr);
+    bdd_vars[0] = Cudd_ReadLogicZero(mgr);
+    Cudd_Ref(bdd_vars[0]);
+
+    std::vector<std::vector<int>> graph(M+1);
+    std::vector<int> visited(M+1,0);
+    std::vector<int> order;
+    for(const auto& gate : aig.gates){
+        graph[gate.lhs / 2].push_back(gate.rhs0 / 2);
+        graph[gate.lhs / 2].push_back(gate.rhs1 / 2);
+    }
+    topologicalSort(output_idx/2, graph, visited, order);
+    std::vector<int> perm;
+    for(auto num: order) 
+        if(num >= 1 && num <= I) 
+            perm.push_back(num);
+
+    for(auto i: perm){
+        bdd_vars[i] = Cudd_bddIthVar(mgr, i);
+        Cudd_Ref(bdd_vars[i]);
+    }
+    // 不在输出锥中的输入不会成为BDD结点, 固定它们的层次, 重排序时不必移动
+    for(int i = 0; i < Cudd_ReadSize(mgr); i++)
+        if(i == 0 || bdd_vars[i] == nullptr)
+            Cudd_bddBindVar(mgr, i);
+    
+    Cudd_AutodynEnable(mgr, CUDD_REORDER_GROUP_SIFT);
+    //aig AND gates, 不在输出锥中的门直接跳过
+    for(const auto& gate : aig.gates){
+        int lhs = gate.lhs;
+        int rhs0 = gate.rhs0;
+        int rhs1 = gate.rhs1;
+        int id_lhs = lhs / 2;
+        if(!visited[id_lhs])
+            continue;
+        bdd_vars[id_lhs] = Cudd_bddAnd(mgr,
+            (rhs0 & 1) ? Cudd_Not(bdd_vars[rhs0/2]): bdd_vars[rhs0/2],
+            (rhs1 & 1) ? Cudd_Not(bdd_vars[rhs1/2]): bdd_vars[rhs1/2]);
+        Cudd_Ref(bdd_vars[id_lhs]);
+    }
+
+
+    DdNode* output_bdd = bdd_vars[output_idx / 2];
+    if (output_idx & 1) output_bdd = Cudd_Not(output_bdd);
+    Cudd_Ref(output_bdd);
+
+    Cudd_AutodynDisable(mgr);
+    //Cudd_ReduceHeap(mgr, CUDD_REORDER_SIFT, 0);
+    
+
+    countSampleDag(mgr, output_bdd, I + 1, dag);
+
+    Cudd_RecursiveDeref(mgr, output_bdd);
+    for(auto& bdd_var : bdd_vars) 
+        if (bdd_var != nullptr) 
+            Cudd_RecursiveDeref(mgr, bdd_var);
+        
+    Cudd_Quit(mgr);
+    return true;
+}
+
+// 从ASCII AIGER (aag) 构建采样DAG
+bool buildDagFromAig(std::istream& aig_fin, SampleDag& dag){
+    Aig aig;
+    return parseAig(aig_fin, aig) && buildDagFromAig(aig, dag);
+}
+
+bool buildDagFromAig(const std::string& aig_filename, SampleDag& dag){
+    //aig input
+    std::ifstream aig_fin(aig_filename);
+    if (!aig_fin) {
+        std::cerr<<"Cannot open "<<aig_filename<<"\n";
+        return false;
+    }
+    return buildDagFromAig(aig_fin, dag);
+}
+
+// 读变量表. json_to_verilog输出的变量表以"varmap <变量数>"开头, 之后每行为
+// "名字 位宽 是否有符号 AIG输入起始下标 AIG输入结束下标"; 也接受只有各变量位宽的旧格式,
+// 此时变量依次占用连续的输入
+bool readVarMap(const std::string& map_filename, std::vector<VarLayout>& vars){
+    std::ifstream map_fin(map_filename);
+    if (!map_fin) {
+        std::cerr<<"Cannot open "<<map_filename<<"\n";
+        return false;
+    }
+    std::string tag;
+    if(!(map_fin >> std::ws) || map_fin.peek() != 'v'){
+        std::vector<int> bitwidths;
+        int width;
+        while(map_fin >> width)
+            bitwidths.push_back(width);
+        vars = layoutVariables(bitwidths);
+        return true;
+    }
+    size_t num_vars;
+    if(!(map_fin >> tag >> num_vars) || tag != "varmap"){
+        std::cerr<<"Bad variable map "<<map_filename<<"\n";
+        return false;
+    }
+    for(size_t i = 0; i < num_vars; i++){
+        std::string name;
+        uint32_t width, first_input, last_input;
+        int is_signed;
+        if(!(map_fin >> name >> width >> is_signed >> first_input >> last_input) || width == 0
+           || last_input < first_input || last_input - first_input + 1 != width){
+            std::cerr<<"Bad variable map "<<map_filename<<"\n";
+            return false;
+        }
+        // path中第0位对应常量, 第i个AIG输入对应第i+1位
+        vars.push_back(VarLayout{first_input + 1, width, name});
+    }
+    return true;
+}
+
+// 固定位报告: 第一行 "fixed N", 之后每个含固定位的变量一行 "名字 位宽 掩码 取值",
+// 掩码和取值为十六进制 (高位在前), 掩码中的位在所有解中都取取值中对应的值
+bool writeFixedReport(const SampleDags& dags, const std::vector<VarLayout>& vars, const std::string& filename){
+    size_t words = (pathBits(vars) + 63) / 64;
+    std::vector<uint64_t> mask(words, 0), values(words, 0);
+    for(const SampleDag* dag : dags){
+        for(size_t i = 0; i < words && i < dag->fixed_mask.size(); i++){
+            mask[i] |= dag->fixed_mask[i];
+            values[i] |= dag->path_template[i] & dag->fixed_mask[i];
+        }
+    }
+    std::string lines;
+    size_t count = 0;
+    for(size_t v = 0; v < vars.size(); v++){
+        const VarLayout& var = vars[v];
+        std::vector<uint64_t> var_mask((var.width + 63) / 64), var_values(var_mask.size());
+        extractBits(mask.data(), var.first_bit, var.width, var_mask.data());
+        extractBits(values.data(), var.first_bit, var.width, var_values.data());
+        if(std::all_of(var_mask.begin(), var_mask.end(), [](uint64_t w){ return w == 0; }))
+            continue;
+        std::string hex(2 * ((var.width + 3) / 4), ' ');
+        encodeHex(var_mask.data(), var.width, &hex[0]);
+        encodeHex(var_values.data(), var.width, &hex[(var.width + 3) / 4]);
+        lines += (var.name.empty() ? "var_" + std::to_string(v) : var.name) + " " + std::to_string(var.width) + " "
+               + hex.substr(0, (var.width + 3) / 4) + " " + hex.substr((var.width + 3) / 4) + "\n";
+        count++;
+    }
+    std::ofstream fout(filename);
+    fout << "fixed " << count << "\n" << lines;
+    if(!fout){
+        std::cerr<<"Cannot write "<<filename<<"\n";
+        return false;
+    }
+    return true;
+}
+
+bool isFormatName(const std::string& format_name){
+    return format_name == "json" || format_name == "ndjson" || format_name == "memh" || format_name == "bin";
+}
+
+// 按名字创建输出格式
+std::unique_ptr<SampleFormat> makeFormat(const std::string& format_name, bool compact, const std::vector<VarLayout>& vars){
+    if(format_name == "bin")
+        return std::make_unique<BinaryFormat>(vars);
+    if(format_name == "memh")
+        return std::make_unique<MemhFormat>(vars);
+    return std::make_unique<JsonFormat>(vars, format_name == "ndjson" ? JsonFormat::NDJSON :
+                                              compact ? JsonFormat::COMPACT : JsonFormat::PRETTY);
+}
+
+// 按指定格式采样并写到output_filename ("-"表示标准输出), 返回进程的退出码
+int writeOutput(const SampleDags& dags, const std::vector<VarLayout>& vars, const std::string& format_name, bool compact,
+                int num_samples, unsigned seed, int num_threads, const std::string& output_filename){
+    // 任一部分的根是取反的常量1: 约束不可满足
+    for(const SampleDag* dag : dags){
+        if(dag->root == 1 && num_samples > 0){
+            std::cerr<<"Constraints are unsatisfiable\n";
+            return 1;
+        }
+    }
+    std::unique_ptr<SampleFormat> format = makeFormat(format_name, compact, vars);
+
+    if(output_filename != "-" && format->writeMapped())
+        return writeSamplesMapped(dags, vars, *format, num_samples, seed, num_threads, output_filename) ? 0 : 1;
+
+    std::ofstream output_fout;
+    if(output_filename != "-"){
+        output_fout.open(output_filename, std::ios::binary);
+        if (!output_fout) {
+            std::cerr<<"Cannot open "<<output_filename<<"\n";
+            return 1;
+        }
+    }
+    std::ostream& out = output_filename == "-" ? std::cout : output_fout;
+    AsyncWriter writer(out);
+    writeSamples(dags, vars, *format, num_samples, seed, num_threads, writer);
+    if (!writer.finish()) {
+        std::cerr<<"Cannot write "<<output_filename<<"\n";
+        return 1;
+    }
+    return 0;
+}